@@ -1,5 +1,8 @@
 #include "sosimple/utilities.hpp"
 #include "sosimple/endpoint.hpp"
+#include "sosimple/buffer.hpp"
+#include "sosimple/framer.hpp"
+#include "sosimple/stream_buffer.hpp"
 #include "sosimple/socket.hpp"
 #include "sosimple/worker.hpp"
 #include "sosimple/pending.hpp"
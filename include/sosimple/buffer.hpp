@@ -0,0 +1,69 @@
+#if !defined SOSIMPLE_BUFFER_HPP
+#define SOSIMPLE_BUFFER_HPP
+
+#include "sosimple/exports.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace sosimple {
+
+struct BufferBlock;
+
+/** received bytes in a pooled, reference counted buffer. copies share the bytes, the buffer goes back to the pool
+ * once the last copy is gone. hold on to buffers as long as you need, but every buffer held is one the pool has to
+ * replace.
+ */
+class SOSIMPLE_API Buffer {
+    BufferBlock* mBlock{nullptr};
+    const uint8_t* mData{nullptr};
+    size_t mSize{0};
+
+public:
+    Buffer() = default;
+    /// takes over one reference to the block
+    Buffer(BufferBlock* block, size_t size);
+    ~Buffer();
+
+    Buffer(const Buffer& other);
+    Buffer(Buffer&& other) noexcept;
+    Buffer& operator=(const Buffer& other);
+    Buffer& operator=(Buffer&& other) noexcept;
+
+    inline auto
+    data() const -> const uint8_t*
+    { return mData; }
+
+    inline auto
+    size() const -> size_t
+    { return mSize; }
+
+    inline auto
+    empty() const -> bool
+    { return mSize == 0; }
+
+    inline auto
+    begin() const -> const uint8_t*
+    { return mData; }
+
+    inline auto
+    end() const -> const uint8_t*
+    { return mData + mSize; }
+
+    inline auto
+    span() const -> std::span<const uint8_t>
+    { return {mData, mSize}; }
+
+    /// a part of this buffer, sharing the bytes. out of range parts are cut to what's there
+    auto
+    slice(size_t offset, size_t count = SIZE_MAX) const -> Buffer;
+
+    /// copy the bytes out
+    auto
+    toVector() const -> std::vector<uint8_t>;
+};
+
+}
+
+#endif
@@ -44,9 +44,9 @@ private:
 public:
     // copy & move
     Endpoint(const Endpoint&);
-    Endpoint(Endpoint&&);
+    Endpoint(Endpoint&&) noexcept;
     Endpoint& operator=(const Endpoint&);
-    Endpoint& operator=(Endpoint&&);
+    Endpoint& operator=(Endpoint&&) noexcept;
 
     // sort & compare
     auto
@@ -0,0 +1,84 @@
+#if !defined SOSIMPLE_FRAMER_HPP
+#define SOSIMPLE_FRAMER_HPP
+
+#include "sosimple/exports.hpp"
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace sosimple {
+
+/**
+ * Splits a tcp stream into messages, see ComSocket::setFramer. The socket calls back once per message instead of once
+ * per read. Messages that came in with a single read are handed out without copying, only messages spread over
+ * multiple reads are put back together.
+ * Implement this for protocols the framers below don't cover.
+ */
+class SOSIMPLE_API Framer {
+public:
+    /// a frame is a header, the message and a trailer, in that order. header and trailer are not handed out
+    struct Frame {
+        size_t header{0};
+        size_t size{0};
+        size_t trailer{0};
+    };
+
+    virtual ~Framer() = default;
+
+    /// look for the frame at the start of data. data always starts at a frame boundary, and until a frame is
+    /// returned, every call gets the same bytes as the last one, plus what was received since
+    /// @return the frame, nothing if data doesn't hold all of it yet
+    /// @throws socket_error if data can't be framed, the socket is closed then
+    virtual auto
+    next(std::span<const uint8_t> data) -> std::optional<Frame> = 0;
+};
+
+/// messages with their size in front
+class SOSIMPLE_API LengthPrefixFramer : public Framer {
+    unsigned mWidth;
+    std::endian mOrder;
+    size_t mMaxSize;
+
+public:
+    /// @param width bytes of the size field, 1, 2, 4 or 8
+    /// @param order byte order of the size field
+    /// @param maxSize bigger messages are treated as a broken stream, instead of buffering them up
+    explicit LengthPrefixFramer(unsigned width=4, std::endian order=std::endian::big, size_t maxSize=16<<20);
+
+    auto
+    next(std::span<const uint8_t> data) -> std::optional<Frame> override;
+};
+
+/// messages that end with a delimiter, like lines of text
+class SOSIMPLE_API DelimiterFramer : public Framer {
+    std::vector<uint8_t> mDelimiter;
+    size_t mMaxSize;
+    size_t mSearched{0}; ///< bytes already searched for the delimiter in the current frame
+
+public:
+    /// @param maxSize messages that don't end within this many bytes are treated as a broken stream
+    explicit DelimiterFramer(std::vector<uint8_t> delimiter, size_t maxSize=64<<10);
+    explicit DelimiterFramer(std::string_view delimiter="\n", size_t maxSize=64<<10);
+
+    auto
+    next(std::span<const uint8_t> data) -> std::optional<Frame> override;
+};
+
+/// messages that all have the same size
+class SOSIMPLE_API FixedSizeFramer : public Framer {
+    size_t mSize;
+
+public:
+    explicit FixedSizeFramer(size_t size);
+
+    auto
+    next(std::span<const uint8_t> data) -> std::optional<Frame> override;
+};
+
+}
+
+#endif
@@ -4,6 +4,9 @@
 #include "sosimple/platforms.hpp"
 #include "sosimple/endpoint.hpp"
 #include "sosimple/utilities.hpp"
+#include "sosimple/buffer.hpp"
+#include "sosimple/framer.hpp"
+#include "sosimple/stream_buffer.hpp"
 #include <chrono>
 
 namespace sosimple {
@@ -12,11 +15,14 @@ class ComSocket;
 class ListenSocket;
 
 
+/// @param coalesce let the kernel merge datagrams of the same flow into one receive (UDP_GRO, Linux 5.0). they are
+/// still handed out one by one, split up again in user space. ignored where not supported
 SOSIMPLE_API auto
-createUDPUnicast(Endpoint bind) -> std::shared_ptr<ComSocket>;
+createUDPUnicast(Endpoint bind, bool coalesce=false) -> std::shared_ptr<ComSocket>;
 
+/// @param coalesce see createUDPUnicast
 SOSIMPLE_API auto
-createUDPMulticast(Endpoint bind, Endpoint multicastgroup) -> std::shared_ptr<ComSocket>;
+createUDPMulticast(Endpoint bind, Endpoint multicastgroup, bool coalesce=false) -> std::shared_ptr<ComSocket>;
 
 SOSIMPLE_API auto
 createTCPListen(Endpoint bind) -> std::shared_ptr<ListenSocket>;
@@ -24,6 +30,27 @@ createTCPListen(Endpoint bind) -> std::shared_ptr<ListenSocket>;
 SOSIMPLE_API auto
 createTCPClient(Endpoint local, Endpoint remote) -> std::shared_ptr<ComSocket>;
 
+/**
+ * Set how many threads poll sockets for incoming data, defaults to 1. Every socket is assigned to the least busy poll
+ * thread when it is created, so this should be called before creating sockets. Sockets that already exist stay on
+ * their thread.
+ */
+SOSIMPLE_API auto
+setPollThreads(unsigned count) -> void;
+
+/// how poll threads wait for socket io
+enum class SOSIMPLE_API IOBackend {
+    Epoll, ///< readiness based, every ready socket is read with recv/accept calls. this is the default
+    IOUring, ///< completion based, with multishot receive and accept requests. needs Linux 6.0, falls back to Epoll otherwise
+};
+
+/**
+ * Select the io backend for poll threads. Poll threads are started with the first sockets assigned to them and keep
+ * their backend, so this should be called before creating sockets.
+ */
+SOSIMPLE_API auto
+setIOBackend(IOBackend backend) -> void;
+
 
 /**
  * More or less a wrapper for posix sockets, with factory methods for different kinds of connections.
@@ -93,6 +120,21 @@ public:
 class SOSIMPLE_API ComSocket : public Socket {
 public:
     using PacketReceivedCallback = std::function<void(const std::vector<uint8_t>&, Endpoint)>;
+    using BufferReceivedCallback = std::function<void(const Buffer&, Endpoint)>;
+    /// a packet as handed out in batches
+    struct Packet {
+        Buffer payload;
+        Endpoint remote;
+    };
+    using PacketsReceivedCallback = std::function<void(const std::vector<Packet>&)>;
+    /// a datagram for sendBatch. the payload is only borrowed for the call
+    struct Datagram {
+        std::span<const uint8_t> payload;
+        Endpoint remote;
+    };
+    using StreamCallback = std::function<void(StreamBuffer&)>;
+    using WritableCallback = std::function<void()>;
+    using SentCallback = std::function<void()>;
 
 protected:
     ComSocket() = default;
@@ -104,12 +146,105 @@ public:
     virtual auto
     getRemoteEndpoint() const -> Endpoint = 0;
 
+    /// receive packets as vectors. every packet is copied out of the receive buffer for this
     virtual auto
     onPacket(PacketReceivedCallback callback) -> void = 0;
 
-    /// send a bunch of bytes. remote is ignored for udp multicast and tcp sockets
+    /// receive packets without copying them out of the receive buffer. replaces the onPacket callback and vice versa
+    virtual auto
+    onPacketBuffer(BufferReceivedCallback callback) -> void = 0;
+
+    /// receive everything read from the socket in one poll pass with a single call, in order. replaces the onPacket
+    /// and onPacketBuffer callbacks and vice versa
+    virtual auto
+    onPackets(PacketsReceivedCallback callback) -> void = 0;
+
+    /// read the tcp stream in place: the socket receives into a ring buffer and the callback is called whenever more
+    /// arrived. it peeks at everything that's there and consumes what it could use, the rest stays for the next call.
+    /// once the ring is full, the socket stops reading until something is consumed, so capacity (rounded up to whole
+    /// pages) has to hold the largest message. only the first call creates the ring, later calls replace the callback.
+    /// the packet callbacks and the framer don't apply anymore after this. ignored for udp
+    virtual auto
+    onStream(StreamCallback callback, size_t capacity=65536) -> void = 0;
+
+    /// how many datagrams udp sockets read with one system call, if the platform supports it (recvmmsg on Linux).
+    /// defaults to 32, at most 64. 1 reads them one by one. ignored for tcp
+    virtual auto
+    setReceiveBatch(unsigned count) -> void = 0;
+
+    /// split the tcp stream into messages, every callback gets one message instead of what a read returned. nullptr
+    /// hands out reads as they are again. ignored for udp
+    virtual auto
+    setFramer(std::unique_ptr<Framer> framer) -> void = 0;
+
+    /// how many bytes tcp sockets read at once. reads start at minimum and double up to maximum while they keep
+    /// filling the buffer, and halve again once they come in at a quarter or less. the same value twice fixes the size.
+    /// defaults to 4KiB up to 64KiB, which is also the most. ignored for udp and on the io_uring backend, which reads
+    /// into buffers of its own
+    virtual auto
+    setReadChunkSize(size_t minimum, size_t maximum) -> void = 0;
+
+    /// datagrams that were dropped, because they were larger than the receive buffer. udp sockets receive up to 64KiB,
+    /// except on the io_uring backend, where a socket switches to 64KiB after the first datagram that didn't fit 4KiB.
+    /// always 0 for tcp
+    virtual auto
+    getTruncatedCount() const -> uint64_t = 0;
+
+    /// send a bunch of bytes. remote is ignored for udp multicast and tcp sockets.
+    /// tcp keeps what the kernel didn't take right away in a send queue and sends it once the socket is writable again,
+    /// in order. udp datagrams that don't fit the send buffer are dropped
     virtual auto
     send(const std::vector<uint8_t>& payload, Endpoint remote={}) const -> void = 0;
+
+    /// send the parts as if they were one payload, without putting them together first (sendmsg on Linux). e.g. a header
+    /// built on the stack and a cached body. udp sends them as one datagram
+    virtual auto
+    send(std::span<const std::span<const uint8_t>> parts, Endpoint remote={}) const -> void = 0;
+
+    /// send many datagrams with as few system calls as possible (sendmmsg on Linux, up to 1024 at once), e.g. to fan
+    /// out an update to a lot of subscribers. remote is ignored for udp multicast and tcp, which sends the payloads
+    /// one after the other through its send queue
+    /// @return how many datagrams, from the front, the kernel took. once the send buffer is full the rest isn't sent,
+    /// pass them again later. always all of them for tcp
+    virtual auto
+    sendBatch(std::span<const Datagram> datagrams) const -> size_t = 0;
+
+    /// send a large tcp payload without copying it (MSG_ZEROCOPY, Linux 4.14). the bytes are only borrowed: leave them
+    /// untouched until sent is called, which happens once the kernel is done with them. it keeps its place in the send
+    /// queue like any other send. payloads under 16KiB, udp and platforms without it are copied as usual, and sent
+    /// follows soon after. the kernel copies on loopback anyways, the socket goes back to copying once it reports that.
+    /// sent runs like the other callbacks, never from within this call, except on a closed socket without a worker
+    /// running. once the socket is closed or destroyed, it still runs for payloads the kernel is done with or never
+    /// got (without a worker, in the destructor). if the kernel might still send from the bytes, sent never runs and
+    /// the bytes stay borrowed: there's no way to learn when it's done with them anymore
+    virtual auto
+    sendZeroCopy(std::span<const uint8_t> payload, SentCallback sent, Endpoint remote={}) const -> void = 0;
+
+    /// send length bytes of a file from offset on, in order with the other sends of a tcp socket. on Linux they go from
+    /// the page cache to the socket with sendfile, as the socket takes them, and never pass through user space. the file
+    /// is duplicated, close it whenever you like. it has to be a regular file with at least offset + length bytes.
+    /// elsewhere it's read and sent as usual
+    virtual auto
+    sendFile(int file, uint64_t offset, size_t length) const -> void = 0;
+
+    /// split udp send() payloads larger than size into datagrams of size bytes, e.g. the path MTU minus headers. the
+    /// kernel does the splitting where it can (UDP_SEGMENT, Linux 4.18), up to 64 datagrams per system call, otherwise
+    /// they go out with sendBatch. only send() with a single payload is split, gather sends and sendBatch send their
+    /// datagrams as they are. sizes over 65507 are cut down to it, 0 turns it off again. ignored for tcp
+    virtual auto
+    setSegmentSize(uint16_t size) -> void = 0;
+
+    /// bytes in the send queue of a tcp socket
+    virtual auto
+    getSendQueueSize() const -> size_t = 0;
+
+    /// the send queue never refuses data, hold back once it grows past high and wait for the writable callback. it's
+    /// called once the queue drained down to low again. defaults to 1MiB and 256KiB
+    virtual auto
+    setSendWatermarks(size_t high, size_t low) -> void = 0;
+
+    virtual auto
+    onWritable(WritableCallback callback) -> void = 0;
 };
 
 }
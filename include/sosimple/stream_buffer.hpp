@@ -0,0 +1,73 @@
+#if !defined SOSIMPLE_STREAM_BUFFER_HPP
+#define SOSIMPLE_STREAM_BUFFER_HPP
+
+#include "sosimple/exports.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+
+namespace sosimple {
+
+class ComSocketImpl;
+
+/**
+ * Receive buffer of a tcp socket in stream mode, see ComSocket::onStream. The socket receives straight into it, the
+ * stream callback looks at what arrived and consumes as much as it can use, the rest stays in place for the next call.
+ * It's a ring that is mapped twice in a row, so the bytes are always in one piece.
+ * Peeking and consuming is for the stream callback only. Once the buffer is full, the socket stops reading until
+ * something is consumed.
+ */
+class SOSIMPLE_API StreamBuffer {
+    uint8_t* mData{nullptr}; ///< mCapacity bytes, followed by the same bytes again
+    size_t mCapacity{0};
+    std::atomic_uint64_t mHead{0}; ///< bytes consumed so far
+    std::atomic_uint64_t mTail{0}; ///< bytes received so far
+    std::atomic_bool mStalled{false}; ///< the socket stopped reading because the buffer was full
+    std::function<void()> mOnSpace{}; ///< let the socket read again, after consuming from a stalled buffer
+
+    friend class ComSocketImpl;
+
+    /// free space to receive into, for the socket
+    auto
+    writable() -> std::span<uint8_t>;
+
+    /// mark bytes received into writable() as available
+    auto
+    commit(size_t count) -> void;
+
+    /// mark the buffer as stalled, mOnSpace is called once something is consumed
+    /// @return false if there is space after all, the socket should keep reading
+    auto
+    stall() -> bool;
+
+public:
+    /// @param capacity rounded up to whole pages
+    /// @throws socket_error if the memory can't be mapped
+    explicit StreamBuffer(size_t capacity);
+    ~StreamBuffer();
+
+    StreamBuffer(const StreamBuffer&) = delete;
+    StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+    inline auto
+    capacity() const -> size_t
+    { return mCapacity; }
+
+    /// bytes that can be peeked
+    auto
+    available() const -> size_t;
+
+    /// all available bytes. stays valid until they are consumed
+    auto
+    peek() const -> std::span<const uint8_t>;
+
+    /// drop bytes from the front, at most available()
+    auto
+    consume(size_t count) -> void;
+};
+
+}
+
+#endif
@@ -0,0 +1,115 @@
+#if !defined SOSIMPLE_TASK_HPP
+#define SOSIMPLE_TASK_HPP
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace sosimple {
+
+/** a move-only std::function<bool()>. callables up to INLINE_SIZE bytes are stored inside the task instead of on
+ * the heap, which covers the callbacks this library queues for every packet.
+ */
+class Task {
+public:
+    static constexpr size_t INLINE_SIZE = 96;
+
+private:
+    struct Ops {
+        bool (*call)(void* storage);
+        void (*move)(void* from, void* to); ///< move construct into to and destroy from
+        void (*destroy)(void* storage);
+    };
+
+    template<typename F>
+    static constexpr bool fitsInline = sizeof(F) <= INLINE_SIZE && alignof(F) <= alignof(std::max_align_t)
+        && std::is_nothrow_move_constructible_v<F>;
+
+    template<typename F>
+    static constexpr Ops inlineOps {
+        [](void* storage) -> bool { return static_cast<bool>(std::invoke(*static_cast<F*>(storage))); },
+        [](void* from, void* to) { new (to) F(std::move(*static_cast<F*>(from))); static_cast<F*>(from)->~F(); },
+        [](void* storage) { static_cast<F*>(storage)->~F(); },
+    };
+
+    template<typename F>
+    static constexpr Ops heapOps {
+        [](void* storage) -> bool { return static_cast<bool>(std::invoke(**static_cast<F**>(storage))); },
+        [](void* from, void* to) { *static_cast<F**>(to) = *static_cast<F**>(from); },
+        [](void* storage) { delete *static_cast<F**>(storage); },
+    };
+
+    alignas(std::max_align_t) unsigned char mStorage[INLINE_SIZE];
+    const Ops* mOps{nullptr};
+
+public:
+    Task() = default;
+    Task(std::nullptr_t) {}
+
+    template<typename F, typename Fn = std::decay_t<F>>
+    requires (!std::is_same_v<Fn, Task> && std::is_invocable_r_v<bool, Fn&>)
+    Task(F&& callable)
+    {
+        if constexpr (std::is_pointer_v<Fn> || std::is_member_pointer_v<Fn> || requires { callable == nullptr; }) {
+            if (callable == nullptr) return; // empty std::function or null function pointer, like std::function does
+        }
+        if constexpr (fitsInline<Fn>) {
+            new (mStorage) Fn(std::forward<F>(callable));
+            mOps = &inlineOps<Fn>;
+        } else {
+            *reinterpret_cast<Fn**>(mStorage) = new Fn(std::forward<F>(callable));
+            mOps = &heapOps<Fn>;
+        }
+    }
+
+    Task(Task&& other) noexcept
+    : mOps(other.mOps)
+    {
+        if (!mOps) return;
+        mOps->move(other.mStorage, mStorage);
+        other.mOps = nullptr;
+    }
+
+    auto
+    operator=(Task&& other) noexcept -> Task&
+    {
+        if (this == &other) return *this;
+        reset();
+        if (other.mOps) {
+            other.mOps->move(other.mStorage, mStorage);
+            mOps = std::exchange(other.mOps, nullptr);
+        }
+        return *this;
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task()
+    { reset(); }
+
+    auto
+    reset() -> void
+    {
+        if (!mOps) return;
+        std::exchange(mOps, nullptr)->destroy(mStorage);
+    }
+
+    explicit
+    operator bool() const
+    { return mOps != nullptr; }
+
+    /** @throws std::bad_function_call if empty */
+    auto
+    operator()() -> bool
+    {
+        if (!mOps) throw std::bad_function_call();
+        return mOps->call(mStorage);
+    }
+};
+
+}
+
+#endif
@@ -20,6 +20,7 @@ namespace sosimple {
         NoMemory, ///< somewhere ran out of memory
         Listen, ///< error listening to connections
         HandleLimit, ///< used all file handles
+        Protocol, ///< received data that can't be framed, e.g. a message above the size limit
     };
 
     /** socket error. use errcode() to check what happened */
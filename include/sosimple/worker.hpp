@@ -4,6 +4,8 @@
 #include "sosimple/exports.hpp"
 
 #include "sosimple/platforms.hpp"
+#include "sosimple/task.hpp"
+#include <cstdint>
 #include <functional>
 #include <chrono>
 #include <optional>
@@ -13,8 +15,11 @@ namespace sosimple {
 
 class SOSIMPLE_API Worker {
 public:
-    /** tasks can return false to stop re-scheduling. returning true on a task that is not periodic does nothing. */
-    using Task = std::function<bool()>;
+    /** tasks can return false to stop re-scheduling. returning true on a task that is not periodic does nothing.
+     * tasks are move-only, small callables are stored without allocating */
+    using Task = sosimple::Task;
+    /** identifies a delayed or periodic task for cancel(). 0 is never handed out */
+    using TaskHandle = uint64_t;
 
 public:
     virtual ~Worker() = default;
@@ -31,7 +36,7 @@ protected:
 
 public:
 
-    /** process tasks once and return next process timepoint. This is mainly interesting if you dont want to block a thread. */
+    /** process tasks once. This is mainly interesting if you dont want to block a thread, don't mix it with looper(). */
     static auto
     think() -> void;
 
@@ -56,8 +61,29 @@ public:
     static auto
     queue(Task task) -> void;
 
+    /**
+     * run a task now and then every interval, until it returns false or is cancelled. an interval of 0 queues an
+     * immediate task instead, that can not be cancelled and returns handle 0.
+     */
+    static auto
+    queue(Task task, std::chrono::milliseconds interval) -> TaskHandle;
+
+    /** run a task once after a delay */
+    static auto
+    queueDelayed(Task task, std::chrono::milliseconds delay) -> TaskHandle;
+
+    /** stop a delayed or periodic task. if it's currently running, it finishes but is not run again.
+     * @return false if the task already completed or was cancelled before */
+    static auto
+    cancel(TaskHandle handle) -> bool;
+
+    /**
+     * Set how many threads process tasks, defaults to 1. Threads that run out of tasks steal queued tasks from busy
+     * ones, while the callbacks of each socket still run in order and one at a time. Delayed and periodic tasks run on the
+     * thread that called looper(). Takes effect with the next looper() or make_thread().
+     */
     static auto
-    queue(Task task, std::chrono::milliseconds interval) -> void;
+    setThreads(unsigned count) -> void;
 
 };
 
@@ -0,0 +1,58 @@
+#include <sosimple/buffer.hpp>
+#include "buffer_pool.hpp"
+
+#include <algorithm>
+#include <utility>
+
+sosimple::Buffer::Buffer(BufferBlock* block, size_t size)
+: mBlock(block), mData(block->data()), mSize(size)
+{}
+
+sosimple::Buffer::~Buffer()
+{
+    if (mBlock) releaseBuffer(mBlock);
+}
+
+sosimple::Buffer::Buffer(const Buffer& other)
+: mBlock(other.mBlock), mData(other.mData), mSize(other.mSize)
+{
+    if (mBlock) mBlock->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+sosimple::Buffer::Buffer(Buffer&& other) noexcept
+: mBlock(std::exchange(other.mBlock, nullptr)), mData(std::exchange(other.mData, nullptr)), mSize(std::exchange(other.mSize, 0))
+{}
+
+auto
+sosimple::Buffer::operator=(const Buffer& other) -> Buffer&
+{
+    if (this != &other) *this = Buffer{other};
+    return *this;
+}
+
+auto
+sosimple::Buffer::operator=(Buffer&& other) noexcept -> Buffer&
+{
+    if (this == &other) return *this;
+    if (mBlock) releaseBuffer(mBlock);
+    mBlock = std::exchange(other.mBlock, nullptr);
+    mData = std::exchange(other.mData, nullptr);
+    mSize = std::exchange(other.mSize, 0);
+    return *this;
+}
+
+auto
+sosimple::Buffer::slice(size_t offset, size_t count) const -> Buffer
+{
+    Buffer part{*this};
+    offset = std::min(offset, mSize);
+    part.mData += offset;
+    part.mSize = std::min(count, mSize - offset);
+    return part;
+}
+
+auto
+sosimple::Buffer::toVector() const -> std::vector<uint8_t>
+{
+    return {mData, mData + mSize};
+}
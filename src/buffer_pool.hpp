@@ -0,0 +1,108 @@
+#if !defined SOSIMPLE_BUFFER_POOL_HPP
+#define SOSIMPLE_BUFFER_POOL_HPP
+
+#include "node_pool.hpp"
+#include <sosimple/buffer.hpp>
+#include <atomic>
+#include <cstring>
+#include <memory>
+
+/// bytes in a pooled receive buffer
+#define SC_BUFFER_BLOCK_SIZE 4096
+/// bytes in a pooled buffer for large datagrams, enough for the biggest udp datagram
+#define SC_LARGE_BUFFER_SIZE 65536
+/// blocks a thread keeps for reuse, of either size
+#define SC_BUFFER_CACHE 1024
+#define SC_LARGE_BUFFER_CACHE 64
+
+namespace sosimple {
+
+/// memory behind Buffer instances. the bytes come with one of the two layouts below
+struct BufferBlock {
+    std::atomic<BufferBlock*> next{nullptr};
+    void* pool{nullptr}; ///< nullptr for blocks that are too big for the pools
+    std::atomic_uint32_t refs{0};
+    bool large{false}; ///< a LargeBufferBlock, otherwise a SmallBufferBlock
+
+    auto
+    data() -> uint8_t*;
+
+    /// only for pooled blocks, oversized ones are exactly as big as they were asked for
+    auto
+    capacity() const -> size_t
+    { return large ? SC_LARGE_BUFFER_SIZE : SC_BUFFER_BLOCK_SIZE; }
+};
+
+/// the bytes right behind the header
+struct SmallBufferBlock : BufferBlock {
+    uint8_t bytes[SC_BUFFER_BLOCK_SIZE];
+};
+
+/// the bytes on the heap, kept while the block is pooled
+struct LargeBufferBlock : BufferBlock {
+    std::unique_ptr<uint8_t[]> bytes{};
+
+    LargeBufferBlock()
+    { large = true; }
+};
+
+inline auto
+BufferBlock::data() -> uint8_t*
+{ return large ? static_cast<LargeBufferBlock*>(this)->bytes.get() : static_cast<SmallBufferBlock*>(this)->bytes; }
+
+using BufferPool = NodePool<SmallBufferBlock, SC_BUFFER_CACHE>;
+using LargeBufferPool = NodePool<LargeBufferBlock, SC_LARGE_BUFFER_CACHE>;
+
+/// @return a pooled block with one reference, for the calling thread to fill
+inline auto
+acquireBuffer() -> BufferBlock*
+{
+    BufferBlock* block = BufferPool::acquire();
+    block->refs.store(1, std::memory_order_relaxed);
+    return block;
+}
+
+/// @return a pooled block of SC_LARGE_BUFFER_SIZE bytes with one reference
+inline auto
+acquireLargeBuffer() -> BufferBlock*
+{
+    LargeBufferBlock* block = LargeBufferPool::acquire();
+    // not touched until something is received into it, so the pages only get mapped as far as datagrams reach
+    if (!block->bytes) block->bytes = std::make_unique_for_overwrite<uint8_t[]>(SC_LARGE_BUFFER_SIZE);
+    block->refs.store(1, std::memory_order_relaxed);
+    return block;
+}
+
+inline auto
+releaseBuffer(BufferBlock* block) -> void
+{
+    if (block->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+    if (!block->pool) delete static_cast<LargeBufferBlock*>(block);
+    else if (block->large) LargeBufferPool::release(static_cast<LargeBufferBlock*>(block));
+    else BufferPool::release(static_cast<SmallBufferBlock*>(block));
+}
+
+/// @return a block with one reference and room for at least size bytes. blocks too big for the pools are allocated
+inline auto
+acquireBuffer(size_t size) -> BufferBlock*
+{
+    if (size <= SC_BUFFER_BLOCK_SIZE) return acquireBuffer();
+    if (size <= SC_LARGE_BUFFER_SIZE) return acquireLargeBuffer();
+    auto* block = new LargeBufferBlock{};
+    block->refs.store(1, std::memory_order_relaxed);
+    block->bytes = std::make_unique_for_overwrite<uint8_t[]>(size);
+    return block;
+}
+
+/// copy bytes into a buffer, for when they can't be received into one directly
+inline auto
+copyBuffer(const uint8_t* data, size_t size) -> Buffer
+{
+    BufferBlock* block = acquireBuffer(size);
+    std::memcpy(block->data(), data, size);
+    return Buffer{block, size};
+}
+
+}
+
+#endif
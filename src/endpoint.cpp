@@ -34,9 +34,9 @@ sosimple::Endpoint::Endpoint(const sockaddr* const addr, socklen_t size)
 }
 
 sosimple::Endpoint::Endpoint(const sosimple::Endpoint&) = default;
-sosimple::Endpoint::Endpoint(sosimple::Endpoint&&) = default;
+sosimple::Endpoint::Endpoint(sosimple::Endpoint&&) noexcept = default;
 sosimple::Endpoint& sosimple::Endpoint::operator=(const sosimple::Endpoint&) = default;
-sosimple::Endpoint& sosimple::Endpoint::operator=(sosimple::Endpoint&&) = default;
+sosimple::Endpoint& sosimple::Endpoint::operator=(sosimple::Endpoint&&) noexcept = default;
 
 auto sosimple::Endpoint::operator==(const sosimple::Endpoint& ep) const -> bool
 {
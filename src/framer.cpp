@@ -0,0 +1,71 @@
+#include <sosimple/framer.hpp>
+#include <sosimple/utilities.hpp>
+
+#include <algorithm>
+#include <format>
+
+sosimple::LengthPrefixFramer::LengthPrefixFramer(unsigned width, std::endian order, size_t maxSize)
+: mWidth(width), mOrder(order), mMaxSize(maxSize)
+{
+    if (width != 1 && width != 2 && width != 4 && width != 8)
+        throw socket_error(SocketError::Configuration, std::format("Length prefix can't be {} bytes wide", width));
+}
+
+auto
+sosimple::LengthPrefixFramer::next(std::span<const uint8_t> data) -> std::optional<Frame>
+{
+    if (data.size() < mWidth) return {};
+    uint64_t size{0};
+    for (unsigned i{0}; i < mWidth; i++) {
+        unsigned shift = (mOrder == std::endian::big) ? (mWidth - 1 - i) * 8 : i * 8;
+        size |= static_cast<uint64_t>(data[i]) << shift;
+    }
+    if (size > mMaxSize)
+        throw socket_error(SocketError::Protocol, std::format("Message of {} bytes is over the limit of {} bytes", size, mMaxSize));
+    if (data.size() - mWidth < size) return {};
+    return Frame{mWidth, static_cast<size_t>(size), 0};
+}
+
+sosimple::DelimiterFramer::DelimiterFramer(std::vector<uint8_t> delimiter, size_t maxSize)
+: mDelimiter(std::move(delimiter)), mMaxSize(maxSize)
+{
+    if (mDelimiter.empty())
+        throw socket_error(SocketError::Configuration, "Delimiter can't be empty");
+}
+
+sosimple::DelimiterFramer::DelimiterFramer(std::string_view delimiter, size_t maxSize)
+: DelimiterFramer(std::vector<uint8_t>{delimiter.begin(), delimiter.end()}, maxSize)
+{}
+
+auto
+sosimple::DelimiterFramer::next(std::span<const uint8_t> data) -> std::optional<Frame>
+{
+    // a delimiter might have started at the end of what was searched last time
+    size_t from = mSearched >= mDelimiter.size() ? mSearched - mDelimiter.size() + 1 : 0;
+    auto found = std::search(data.begin() + std::min(from, data.size()), data.end(), mDelimiter.begin(), mDelimiter.end());
+    if (found == data.end()) {
+        mSearched = data.size();
+        if (data.size() > mMaxSize + mDelimiter.size())
+            throw socket_error(SocketError::Protocol, std::format("No delimiter within {} bytes", mMaxSize));
+        return {};
+    }
+    mSearched = 0;
+    size_t size = static_cast<size_t>(found - data.begin());
+    if (size > mMaxSize)
+        throw socket_error(SocketError::Protocol, std::format("Message of {} bytes is over the limit of {} bytes", size, mMaxSize));
+    return Frame{0, size, mDelimiter.size()};
+}
+
+sosimple::FixedSizeFramer::FixedSizeFramer(size_t size)
+: mSize(size)
+{
+    if (size == 0)
+        throw socket_error(SocketError::Configuration, "Messages can't be empty");
+}
+
+auto
+sosimple::FixedSizeFramer::next(std::span<const uint8_t> data) -> std::optional<Frame>
+{
+    if (data.size() < mSize) return {};
+    return Frame{0, mSize, 0};
+}
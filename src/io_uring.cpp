@@ -0,0 +1,203 @@
+#include "io_uring.hpp"
+
+#if defined __linux__
+
+#include <sosimple/utilities.hpp>
+#include "platforms_internal.hpp"
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+#include <csignal>
+#include <cstdio>
+#include <thread>
+
+/// how often a full submission queue is retried while the kernel answers EBUSY or EAGAIN
+#define SC_URING_SUBMIT_RETRIES 1000
+
+static auto
+uringError(const char* what, int error) -> sosimple::socket_error
+{
+    const char* desc = GNU_STRERRORDESC_NP(error);
+    return sosimple::socket_error(sosimple::SocketError::Configuration,
+            std::string("Unable to set up io_uring, ") + what + ": " + (desc ? desc : "<NULLPTR>"));
+}
+
+sosimple::IOUring::IOUring(unsigned entries, unsigned bufferCount, unsigned bufferSize)
+{
+    io_uring_params params{};
+    params.flags = IORING_SETUP_CLAMP | IORING_SETUP_SUBMIT_ALL;
+    mFD = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+    if (mFD < 0)
+        throw uringError("setup", POSIX_ERRNO);
+    // the destructor won't run if we throw, so clean up whatever we got so far
+    std::unique_ptr<IOUring, void(*)(IOUring*)> guard{this, [](IOUring* self){ self->cleanup(); }};
+
+    // we wait with a timeout (EXT_ARG) and rely on the kernel not dropping completions
+    constexpr unsigned required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+    if ((params.features & required) != required)
+        throw uringError("features", ENOSYS);
+
+    mRingSize = std::max<size_t>(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+                                 params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+    mRing = ::mmap(nullptr, mRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mFD, IORING_OFF_SQ_RING);
+    if (mRing == MAP_FAILED) {
+        mRing = nullptr;
+        throw uringError("ring mapping", POSIX_ERRNO);
+    }
+    mSQEsSize = params.sq_entries * sizeof(io_uring_sqe);
+    mSQEs = static_cast<io_uring_sqe*>(::mmap(nullptr, mSQEsSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mFD, IORING_OFF_SQES));
+    if (mSQEs == MAP_FAILED) {
+        mSQEs = nullptr;
+        throw uringError("sqe mapping", POSIX_ERRNO);
+    }
+
+    auto* ring = static_cast<uint8_t*>(mRing);
+    mSQHead = reinterpret_cast<unsigned*>(ring + params.sq_off.head);
+    mSQTail = reinterpret_cast<unsigned*>(ring + params.sq_off.tail);
+    mSQArray = reinterpret_cast<unsigned*>(ring + params.sq_off.array);
+    mSQMask = *reinterpret_cast<unsigned*>(ring + params.sq_off.ring_mask);
+    mSQEntries = params.sq_entries;
+    mCQHead = reinterpret_cast<unsigned*>(ring + params.cq_off.head);
+    mCQTail = reinterpret_cast<unsigned*>(ring + params.cq_off.tail);
+    mCQEs = reinterpret_cast<io_uring_cqe*>(ring + params.cq_off.cqes);
+    mCQMask = *reinterpret_cast<unsigned*>(ring + params.cq_off.ring_mask);
+
+    // provided buffer ring, the kernel picks a buffer from here when data actually arrives
+    mBufferCount = bufferCount;
+    mBufferSize = bufferSize;
+    mBuffers = std::make_unique<uint8_t[]>(static_cast<size_t>(bufferCount) * bufferSize);
+    mBufferRingSize = bufferCount * sizeof(io_uring_buf);
+    void* bufferRing = ::mmap(nullptr, mBufferRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (bufferRing == MAP_FAILED)
+        throw uringError("buffer ring mapping", POSIX_ERRNO);
+    mBufferRing = static_cast<io_uring_buf_ring*>(bufferRing);
+    io_uring_buf_reg registration{};
+    registration.ring_addr = reinterpret_cast<uint64_t>(mBufferRing);
+    registration.ring_entries = bufferCount;
+    registration.bgid = BUFFER_GROUP;
+    if (::syscall(__NR_io_uring_register, mFD, IORING_REGISTER_PBUF_RING, &registration, 1) < 0) {
+        int error = POSIX_ERRNO;
+        ::munmap(mBufferRing, mBufferRingSize);
+        mBufferRing = nullptr;
+        throw uringError("buffer ring registration", error);
+    }
+    for (unsigned id{0}; id < bufferCount; id++) recycle(static_cast<uint16_t>(id));
+
+    guard.release();
+}
+
+sosimple::IOUring::~IOUring()
+{
+    cleanup();
+}
+
+auto
+sosimple::IOUring::cleanup() -> void
+{
+    if (mBufferRing) {
+        io_uring_buf_reg registration{};
+        registration.bgid = BUFFER_GROUP;
+        ::syscall(__NR_io_uring_register, mFD, IORING_UNREGISTER_PBUF_RING, &registration, 1);
+        ::munmap(mBufferRing, mBufferRingSize);
+        mBufferRing = nullptr;
+    }
+    if (mSQEs) ::munmap(mSQEs, mSQEsSize);
+    if (mRing) ::munmap(mRing, mRingSize);
+    mSQEs = nullptr;
+    mRing = nullptr;
+    if (mFD >= 0) ::close(mFD);
+    mFD = POSIX_INVALID_DESCRIPTOR;
+}
+
+auto
+sosimple::IOUring::isSupported() -> bool
+{
+    utsname name{};
+    if (::uname(&name) != 0) return false;
+    int major{0};
+    if (std::sscanf(name.release, "%d", &major) != 1) return false;
+    return major >= 6;
+}
+
+auto
+sosimple::IOUring::enter(unsigned toSubmit, unsigned minComplete, unsigned flags, void* arg, size_t argSize) -> int
+{
+    int result = static_cast<int>(::syscall(__NR_io_uring_enter, mFD, toSubmit, minComplete, flags, arg, argSize));
+    return result < 0 ? -POSIX_ERRNO : result;
+}
+
+auto
+sosimple::IOUring::submit() -> void
+{
+    std::unique_lock lock{mSubmitMutex};
+    unsigned toSubmit = unsubmitted();
+    if (toSubmit == 0) return;
+    // whatever the kernel doesn't take stays queued and goes with the next submit
+    enter(toSubmit, 0, 0);
+}
+
+auto
+sosimple::IOUring::makeRoom() -> void
+{
+    // EBUSY and EAGAIN pass once the kernel caught up with completions or memory
+    for (unsigned attempt{0}; unsubmitted() >= mSQEntries; attempt++) {
+        int result = enter(unsubmitted(), 0, 0);
+        if (result >= 0 || result == -EINTR) continue;
+        if ((result != -EBUSY && result != -EAGAIN) || attempt >= SC_URING_SUBMIT_RETRIES) {
+            const char* desc = GNU_STRERRORDESC_NP(-result);
+            throw sosimple::socket_error(sosimple::SocketError::Generic,
+                    std::string("Unable to submit to io_uring: ") + (desc ? desc : "<NULLPTR>"));
+        }
+        std::this_thread::yield();
+    }
+}
+
+auto
+sosimple::IOUring::wait(int timeoutMS) -> void
+{
+    unsigned toSubmit;
+    {
+        std::unique_lock lock{mSubmitMutex};
+        toSubmit = unsubmitted();
+    }
+    __kernel_timespec timeout{};
+    io_uring_getevents_arg arg{};
+    arg.sigmask_sz = _NSIG / 8;
+    if (timeoutMS >= 0) {
+        timeout.tv_sec = timeoutMS / 1000;
+        timeout.tv_nsec = (timeoutMS % 1000) * 1'000'000L;
+        arg.ts = reinterpret_cast<uint64_t>(&timeout);
+    }
+    // ETIME, EINTR and EBUSY (completions backlogged) all just mean "go look at what we have"
+    enter(toSubmit, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+}
+
+auto
+sosimple::IOUring::reap(io_uring_cqe* out, unsigned max) -> unsigned
+{
+    unsigned head = *mCQHead;
+    unsigned tail = std::atomic_ref<unsigned>(*mCQTail).load(std::memory_order_acquire);
+    unsigned count{0};
+    for (; head != tail && count < max; head++, count++) {
+        out[count] = mCQEs[head & mCQMask];
+    }
+    std::atomic_ref<unsigned>(*mCQHead).store(head, std::memory_order_release);
+    return count;
+}
+
+auto
+sosimple::IOUring::recycle(uint16_t id) -> void
+{
+    // not mBufferRing->bufs: the flexible array macro in the kernel header puts an empty struct in front of it,
+    // which takes up space in C++ and moves the array by 8 bytes. the entries overlay the ring header in C
+    io_uring_buf& slot = reinterpret_cast<io_uring_buf*>(mBufferRing)[mBufferTail & (mBufferCount - 1)];
+    slot.addr = reinterpret_cast<uint64_t>(buffer(id));
+    slot.len = mBufferSize;
+    slot.bid = id;
+    mBufferTail++;
+    std::atomic_ref<uint16_t>(mBufferRing->tail).store(mBufferTail, std::memory_order_release);
+}
+
+#endif
@@ -0,0 +1,130 @@
+#if !defined SOSIMPLE_IO_URING_HPP
+#define SOSIMPLE_IO_URING_HPP
+
+#if defined __linux__
+
+#include <sosimple/platforms.hpp>
+#include <linux/io_uring.h>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <mutex>
+
+namespace sosimple {
+
+/**
+ * Minimal io_uring wrapper on top of the raw syscalls, so we don't need liburing.
+ * Requests can be queued and submitted from any thread, completions are only reaped by the owning poll thread.
+ * Every ring comes with one group of provided buffers (IOUring::BUFFER_GROUP) for multishot receives.
+ */
+class IOUring {
+    int mFD{POSIX_INVALID_DESCRIPTOR};
+    void* mRing{nullptr};
+    size_t mRingSize{0};
+    io_uring_sqe* mSQEs{nullptr};
+    size_t mSQEsSize{0};
+
+    unsigned* mSQHead{nullptr};
+    unsigned* mSQTail{nullptr};
+    unsigned* mSQArray{nullptr};
+    unsigned mSQMask{0};
+    unsigned mSQEntries{0};
+    unsigned* mCQHead{nullptr};
+    unsigned* mCQTail{nullptr};
+    io_uring_cqe* mCQEs{nullptr};
+    unsigned mCQMask{0};
+
+    std::mutex mSubmitMutex{};
+
+    io_uring_buf_ring* mBufferRing{nullptr};
+    size_t mBufferRingSize{0};
+    std::unique_ptr<uint8_t[]> mBuffers{};
+    unsigned mBufferCount{0};
+    unsigned mBufferSize{0};
+    uint16_t mBufferTail{0}; ///< only touched by the poll thread
+
+    /// unmap and close everything, shared by the destructor and a failing constructor
+    auto
+    cleanup() -> void;
+
+    /// @return the syscall result, negative errno on failure
+    auto
+    enter(unsigned toSubmit, unsigned minComplete, unsigned flags, void* arg=nullptr, size_t argSize=0) -> int;
+
+    /// queued but not yet consumed by the kernel. without SQPOLL it consumes them when we enter
+    auto
+    unsubmitted() const -> unsigned
+    { return *mSQTail - std::atomic_ref<unsigned>(*mSQHead).load(std::memory_order_acquire); }
+
+    /// submit until the kernel took at least one entry of a full submission queue. expects mSubmitMutex to be held
+    /// @throws socket_error if the kernel refuses
+    auto
+    makeRoom() -> void;
+
+public:
+    static constexpr uint16_t BUFFER_GROUP = 0;
+
+    /// @param entries submission queue size
+    /// @param bufferCount number of provided receive buffers, power of two
+    /// @param bufferSize size of each provided receive buffer
+    /// @throws socket_error if the kernel does not support what we need
+    IOUring(unsigned entries, unsigned bufferCount, unsigned bufferSize);
+    ~IOUring();
+
+    IOUring(const IOUring&) = delete;
+    IOUring& operator=(const IOUring&) = delete;
+
+    /// quick check whether the running kernel is recent enough for multishot receive (6.0)
+    static auto
+    isSupported() -> bool;
+
+    /// queue a request. prepare gets a zeroed sqe to fill in. this does not submit, unless the queue is full
+    /// @throws socket_error if the queue is full and the kernel refuses to take anything
+    template<typename Prepare>
+    auto
+    queue(Prepare&& prepare) -> void
+    {
+        std::unique_lock lock{mSubmitMutex};
+        if (unsubmitted() >= mSQEntries) makeRoom();
+        unsigned tail = *mSQTail;
+        unsigned index = tail & mSQMask;
+        io_uring_sqe& sqe = mSQEs[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        prepare(sqe);
+        mSQArray[index] = index;
+        std::atomic_ref<unsigned>(*mSQTail).store(tail + 1, std::memory_order_release);
+    }
+
+    /// hand everything queued so far to the kernel, without waiting for anything
+    auto
+    submit() -> void;
+
+    /// submit everything queued and block until at least one completion is available
+    /// @param timeoutMS -1 to wait indefinitely
+    auto
+    wait(int timeoutMS) -> void;
+
+    /// move up to max completions out of the completion queue
+    /// @return number of completions written to out
+    auto
+    reap(io_uring_cqe* out, unsigned max) -> unsigned;
+
+    auto
+    getBufferSize() const -> unsigned
+    { return mBufferSize; }
+
+    /// @return the provided buffer the kernel picked for a completion flagged IORING_CQE_F_BUFFER
+    auto
+    buffer(uint16_t id) -> uint8_t*
+    { return mBuffers.get() + static_cast<size_t>(id) * mBufferSize; }
+
+    /// give a provided buffer back to the kernel once we are done with its contents
+    auto
+    recycle(uint16_t id) -> void;
+};
+
+}
+
+#endif
+
+#endif
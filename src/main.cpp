@@ -4,6 +4,7 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <atomic>
 
 #define fun auto
 
@@ -116,10 +117,114 @@ tcp_test() -> void
         std::cout << "FAILED\n";
 }
 
+fun
+tcp_queue_test() -> void
+{
+    std::cout << " -- TCP Queue Test" << std::endl;
+    auto worker = sosimple::Worker::make_thread();
+    auto finally = sosimple::on_exit{[&](){
+        sosimple::Worker::stop();
+        worker.join();
+    }};
+
+    std::cout << " Creating sockets" << std::endl;
+    auto sockListen = sosimple::createTCPListen({"lo", 5200});
+    sockListen->onSocketError(onConnectionError);
+    std::atomic_size_t received{0};
+    sosimple::pending<std::shared_ptr<sosimple::ComSocket>> pendingSocket{};
+    sockListen->onAccept([&](std::shared_ptr<sosimple::ComSocket> connection, sosimple::Endpoint remote) {
+        connection->onPacket([&](const std::vector<uint8_t>& packet, sosimple::Endpoint) { received += packet.size(); });
+        connection->onSocketError(onConnectionError);
+        pendingSocket = std::move(connection);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    auto sockClient = sosimple::createTCPClient({"lo", 0}, {"lo", 5200});
+    sockClient->onSocketError(onConnectionError);
+    pendingSocket.wait_for(std::chrono::milliseconds(100));
+    if (!pendingSocket) {
+        std::cout << " Connection failed!" << std::endl;
+        return;
+    }
+
+    // empty sends behind a backlog must neither end up in the queue nor stall it
+    std::cout << " Sending empty payloads behind a backlog" << std::endl;
+    std::vector<uint8_t> block(1024*1024, 0x5a);
+    for (int i = 0; i < 4; i++) sockClient->send(block, {});
+    std::cout << " Queued " << sockClient->getSendQueueSize() << " bytes" << std::endl;
+    sockClient->send(std::vector<uint8_t>{}, {});
+    sockClient->send(std::span<const std::span<const uint8_t>>{}, {});
+    std::atomic_bool sentLast{false};
+    std::thread sender{[&](){
+        // once the backlog is through, only the empty payloads could be left in the queue
+        while (received < 4*block.size()) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        sockClient->send(block, {});
+        sentLast = true;
+    }};
+    for (int i = 0; i < 50 && !sentLast; i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    if (!sentLast) {
+        // the sender is stuck for good, there's no way to clean up
+        std::cout << "FAILED\n";
+        sender.detach();
+        return;
+    }
+    sender.join();
+
+    for (int i = 0; i < 20 && received < 5*block.size(); i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    if (received == 5*block.size())
+        std::cout << "SUCCESS\n";
+    else
+        std::cout << "FAILED\n";
+}
+
+fun
+zerocopy_closed_test() -> void
+{
+    std::cout << " -- Zero Copy Closed Test" << std::endl;
+    // no worker: the callbacks run on the poll thread
+
+    std::cout << " Creating sockets" << std::endl;
+    auto sockListen = sosimple::createTCPListen({"lo", 5300});
+    sockListen->onSocketError(onConnectionError);
+    sosimple::pending<std::shared_ptr<sosimple::ComSocket>> pendingSocket{};
+    sockListen->onAccept([&](std::shared_ptr<sosimple::ComSocket> connection, sosimple::Endpoint remote) {
+        pendingSocket = std::move(connection);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    auto sockClient = sosimple::createTCPClient({"lo", 0}, {"lo", 5300});
+    std::atomic_bool closed{false};
+    sockClient->onSocketError([&](sosimple::socket_error error) { closed = true; });
+    pendingSocket.wait_for(std::chrono::milliseconds(100));
+    if (!pendingSocket) {
+        std::cout << " Connection failed!" << std::endl;
+        return;
+    }
+
+    std::cout << " Closing the connection" << std::endl;
+    pendingSocket.retrieve().reset();
+    for (int i = 0; i < 20 && !closed; i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    // nothing is ever sent on a closed socket, the bytes are handed back all the same
+    std::cout << " Sending on the closed socket" << std::endl;
+    std::vector<uint8_t> payload(64*1024, 0x5a);
+    std::atomic_bool sent{false};
+    sockClient->sendZeroCopy(payload, [&]() { sent = true; });
+    for (int i = 0; i < 20 && !sent; i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    if (closed && sent)
+        std::cout << "SUCCESS\n";
+    else
+        std::cout << "FAILED\n";
+}
+
 fun
 main(int argc, char** argv) -> int
 {
     utils_test();
     udp_test();
     tcp_test();
+    tcp_queue_test();
+    zerocopy_closed_test();
 }
@@ -0,0 +1,89 @@
+#if !defined SOSIMPLE_MPSC_QUEUE_HPP
+#define SOSIMPLE_MPSC_QUEUE_HPP
+
+#include "node_pool.hpp"
+#include <atomic>
+#include <optional>
+
+/// queue nodes a thread keeps for reuse
+#define SC_QUEUE_NODE_CACHE 4096
+
+namespace sosimple {
+
+/**
+ * Multi producer single consumer queue after Dmitry Vyukov. Pushing is one atomic exchange and never waits on
+ * other threads, popping is reserved to a single consumer thread.
+ */
+template<typename T>
+class MPSCQueue {
+    struct Node {
+        std::atomic<Node*> next{nullptr};
+        T value{};
+        void* pool{nullptr}; ///< cache of the NodePool this node goes back to
+    };
+    using Pool = NodePool<Node, SC_QUEUE_NODE_CACHE>;
+    std::atomic<Node*> head; ///< producers append here
+    Node* tail; ///< consumer side, always one node behind the oldest value
+    Node stub{};
+
+    auto
+    push(Node* node) -> void
+    {
+        node->next.store(nullptr, std::memory_order_relaxed);
+        Node* previous = head.exchange(node);
+        // between the exchange and this store the queue is not empty, but the consumer can't see the node yet
+        previous->next.store(node, std::memory_order_release);
+    }
+
+public:
+    MPSCQueue() : head(&stub), tail(&stub) {}
+    ~MPSCQueue()
+    { while (pop()) {} }
+    MPSCQueue(const MPSCQueue&) = delete;
+    MPSCQueue& operator=(const MPSCQueue&) = delete;
+
+    /// can be called from any thread
+    auto
+    push(T value) -> void
+    {
+        Node* node = Pool::acquire();
+        node->value = std::move(value);
+        push(node);
+    }
+
+    /// consumer only
+    /// @return the oldest value, nothing if the queue is empty or a producer is halfway through pushing
+    auto
+    pop() -> std::optional<T>
+    {
+        Node* node = tail;
+        Node* next = node->next.load(std::memory_order_acquire);
+        if (node == &stub) {
+            if (!next) return {};
+            tail = next;
+            node = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+        if (!next) {
+            if (node != head.load(std::memory_order_acquire)) return {};
+            // node is the last one, put the stub behind it so it can be handed out
+            push(&stub);
+            next = node->next.load(std::memory_order_acquire);
+            if (!next) return {};
+        }
+        tail = next;
+        std::optional<T> value{std::move(node->value)};
+        node->value = T{};
+        Pool::release(node);
+        return value;
+    }
+
+    /// consumer only. a push that is still in progress counts as not empty
+    auto
+    empty() const -> bool
+    { return tail == &stub && head.load() == &stub; }
+};
+
+}
+
+#endif
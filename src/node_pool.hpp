@@ -0,0 +1,110 @@
+#if !defined SOSIMPLE_NODE_POOL_HPP
+#define SOSIMPLE_NODE_POOL_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace sosimple {
+
+/**
+ * Recycles fixed size nodes, so hot paths don't go to the allocator once things are warmed up. Nodes need an atomic
+ * next pointer and a void* pool member for bookkeeping.
+ * Every thread takes nodes from its own cache. Nodes are usually released on another thread than they came from, so
+ * whoever is done with a node hands it back to the cache it came from, which the owner collects all at once when it
+ * runs dry.
+ * Caches of threads that exit are adopted by new threads.
+ * A cache keeps about Limit nodes, more are deleted when they come back, so a burst doesn't stay resident for good.
+ */
+template<typename Node, size_t Limit>
+class NodePool {
+    struct Cache {
+        Node* local{nullptr}; ///< only touched by the owning thread
+        std::atomic<Node*> returned{nullptr}; ///< nodes handed back from other threads
+        std::atomic_size_t count{0}; ///< nodes in returned, give or take the ones being pushed while it's collected
+    };
+
+    std::mutex mutex; ///< only taken when threads start or exit
+    std::vector<std::unique_ptr<Cache>> caches{};
+    std::vector<Cache*> orphans{};
+
+    auto
+    adopt() -> Cache*
+    {
+        std::unique_lock lock{mutex};
+        if (!orphans.empty()) {
+            Cache* cache = orphans.back();
+            orphans.pop_back();
+            return cache;
+        }
+        return caches.emplace_back(std::make_unique<Cache>()).get();
+    }
+
+    auto
+    abandon(Cache* cache) -> void
+    {
+        std::unique_lock lock{mutex};
+        orphans.push_back(cache);
+    }
+
+    struct Owner {
+        Cache* cache{NodePool::get().adopt()};
+        ~Owner()
+        { NodePool::get().abandon(cache); }
+    };
+
+    NodePool() = default;
+
+public:
+    static auto
+    get() -> NodePool&
+    {
+        // never destroyed, queues in other statics hand nodes back while the process exits
+        static NodePool& instance = *new NodePool{};
+        return instance;
+    }
+
+    /// a fresh node, or a recycled one. the contents are left as they are
+    static auto
+    acquire() -> Node*
+    {
+        thread_local Owner owner{};
+        Cache* cache = owner.cache;
+        if (!cache->local) {
+            cache->local = cache->returned.exchange(nullptr, std::memory_order_acquire);
+            if (cache->local) cache->count.store(0, std::memory_order_relaxed);
+        }
+        Node* node = cache->local;
+        if (!node) {
+            node = new Node;
+        } else {
+            // nodes may link their base type
+            cache->local = static_cast<Node*>(node->next.load(std::memory_order_relaxed));
+        }
+        node->pool = cache;
+        return node;
+    }
+
+    /// can be called from any thread
+    static auto
+    release(Node* node) -> void
+    {
+        auto* cache = static_cast<Cache*>(node->pool);
+        if (cache->count.fetch_add(1, std::memory_order_relaxed) >= Limit) {
+            cache->count.fetch_sub(1, std::memory_order_relaxed);
+            delete node;
+            return;
+        }
+        Node* head = cache->returned.load(std::memory_order_relaxed);
+        do {
+            node->next.store(head, std::memory_order_relaxed);
+        } while (!cache->returned.compare_exchange_weak(head, node, std::memory_order_release, std::memory_order_relaxed));
+    }
+};
+
+}
+
+#endif
@@ -4,19 +4,29 @@
 
 #include "socket_impl.hpp"
 #include "socket_poller.hpp"
+#include "buffer_pool.hpp"
 #include "platforms_internal.hpp"
 
-#define SC_DEFAULT_BUFFER_SIZE 4096
+#include <climits>
+
+#if defined __linux__
+#include <netinet/udp.h>
+#include <linux/errqueue.h>
+#include <sys/sendfile.h>
+#include <fcntl.h>
+#elif defined _WIN32
+#include <io.h>
+#endif
 
-/// mark socket as connected. a connected socket does not accept a remote argument when sending
-#define SC_SOCKFLAG_CONNECTED 1
-/// flag a socket as closed: whether is has been opened or not, this socket is dead
-#define SC_SOCKFLAG_CLOSED 2
+#define SC_DEFAULT_BUFFER_SIZE 4096
 
 /// marking the socket closed, closing the file descriptor and notifying gets a bit repetitive...
+/// the poll thread and a sending thread can fail at once, only the first one closes
 #define SOSIMPLE_SOCKET_ERROR(ERROR_ENUM, MESSAGE) {\
-    mFlags |= SC_SOCKFLAG_CLOSED; \
-    POSIX_CLOSE(mFD); \
+    if ((mFlags.fetch_or(SC_SOCKFLAG_CLOSED) & SC_SOCKFLAG_CLOSED) == 0) { \
+        if (mReactor) mReactor->release(*this); \
+        POSIX_CLOSE(mFD); \
+    } \
     notifySocketError(socket_error((ERROR_ENUM), (MESSAGE))); \
 }
 
@@ -75,8 +85,26 @@ setDefaultSockOpts(int fd) -> void
         throw sosimple::socket_error(sosimple::SocketError::Configuration, "Unable to set socket option SO_RCVBUF: " + errno2str(POSIX_ERRNO));
 }
 
+/// turn on UDP_GRO if the platform has it
+/// @return true if the socket will receive merged datagrams
+static auto
+enableCoalescing(socket_t fd) -> bool
+{
+#if defined __linux__ && defined UDP_GRO
+    int yes = 1;
+    if (POSIX_SETSOCKOPT(fd, SOL_UDP, UDP_GRO, &yes, sizeof(yes))==-1)
+        return false; // kernel before 5.0, datagrams come in one by one as usual
+    // the default receive buffer can't even hold one merged datagram
+    int bufferSz = SC_LARGE_BUFFER_SIZE * 4;
+    POSIX_SETSOCKOPT(fd, SOL_SOCKET, SO_RCVBUF, &bufferSz, sizeof(bufferSz));
+    return true;
+#else
+    return false;
+#endif
+}
+
 auto
-sosimple::createUDPUnicast(Endpoint bindAddr) -> std::shared_ptr<ComSocket>
+sosimple::createUDPUnicast(Endpoint bindAddr, bool coalesce) -> std::shared_ptr<ComSocket>
 {
     SOSIMPLE_SOCKET_INIT;
 
@@ -117,13 +145,15 @@ sosimple::createUDPUnicast(Endpoint bindAddr) -> std::shared_ptr<ComSocket>
 
     // set basic socket options
     setDefaultSockOpts(fd);
+    if (coalesce && enableCoalescing(fd))
+        socket->mFlags |= SC_SOCKFLAG_COALESCED;
 
     socket->start();
     return socket;
 }
 
 auto
-sosimple::createUDPMulticast(Endpoint iface, Endpoint multicastGroup) -> std::shared_ptr<ComSocket>
+sosimple::createUDPMulticast(Endpoint iface, Endpoint multicastGroup, bool coalesce) -> std::shared_ptr<ComSocket>
 {
     SOSIMPLE_SOCKET_INIT;
 
@@ -185,6 +215,8 @@ sosimple::createUDPMulticast(Endpoint iface, Endpoint multicastGroup) -> std::sh
         if (POSIX_SETSOCKOPT(fd, IPPROTO_IPV6, IPV6_MULTICAST_LOOP, &yes, sizeof(yes))==-1)
             throw socket_error(SocketError::Configuration, "Unable to set socket option SO_KEEPALIVE: " + errno2str(POSIX_ERRNO));
     }
+    if (coalesce && enableCoalescing(fd))
+        socket->mFlags |= SC_SOCKFLAG_COALESCED;
 
     socket->start();
     return socket;
@@ -308,6 +340,18 @@ sosimple::createTCPClient(Endpoint bindAddr, Endpoint remote) -> std::shared_ptr
     return socket;
 }
 
+auto
+sosimple::setPollThreads(unsigned count) -> void
+{
+    SocketPoller::get().setThreadCount(count);
+}
+
+auto
+sosimple::setIOBackend(IOBackend backend) -> void
+{
+    SocketPoller::get().setBackend(backend);
+}
+
 auto
 sosimple::createTCPServer(socket_t acceptedSocket, Endpoint remote) -> std::shared_ptr<ComSocket>
 {
@@ -334,7 +378,7 @@ auto
 sosimple::SocketBase::notifySocketError(socket_error error) const -> void
 {
     if (Worker::isStarted())
-        sosimple::Worker::queue([wself=weak_from_this(),error=error](){
+        mStrand->post([wself=weak_from_this(),error=error](){
             auto self = wself.lock();
             if (self) self->mSocketErrorEvent(error);
             return false;
@@ -360,13 +404,16 @@ sosimple::SocketBase::setTimeout(std::chrono::milliseconds timeout) -> void
     } else {
         mWatchDog.setCallback([wself=weak_from_this()](){
             auto self = wself.lock();
-            if (self) {
-                self->mFlags |= 2;
+            if (self && (self->mFlags.fetch_or(SC_SOCKFLAG_CLOSED) & SC_SOCKFLAG_CLOSED)==0) {
+                if (self->mReactor) self->mReactor->release(*self);
                 POSIX_CLOSE(self->mFD);
                 self->notifySocketError(socket_error((SocketError::Timeout), ("Socket watchdog tripped: Timeout")));
             }
+            // trip once, the socket is dead and the poller should stop waking up for it
+            if (self) self->mWatchDog.setTimeout(std::chrono::milliseconds::zero());
         });
     }
+    if (mReactor) mReactor->schedule(*this);
 }
 
 auto
@@ -413,7 +460,7 @@ sosimple::SocketBase::~SocketBase()
 
 sosimple::ListenSocketImpl::~ListenSocketImpl()
 {
-    SocketPoller::get() -= mFD;
+    SocketPoller::get() -= *this;
 }
 
 auto
@@ -435,29 +482,45 @@ sosimple::ListenSocketImpl::accept() -> bool
         if (!POSIX_ISVALIDDESCRIPTOR(fd)) {
             if (error == SOCKET_ERRNO_EAGAIN || error == SOCKET_ERRNO_EWOULDBLOCK || error == SOCKET_ERRNO_EINPROGRESS) {
                 break;
-            } else if (error == SOCKET_ERRNO_ECONNABORTED) {
-                continue; // "a connection?"
-            } else if (error == SOCKET_ERRNO_ENOBUFS || error == SOCKET_ERRNO_ENOMEM) {
-                SOSIMPLE_SOCKET_ERROR(SocketError::NoMemory, "Could not accept connection: "+errno2str(error))
-            } else if (error == SOCKET_ERRNO_EMFILE || error == SOCKET_ERRNO_ENFILE) {
-                SOSIMPLE_SOCKET_ERROR(SocketError::HandleLimit, "Could not accept connection: "+errno2str(error))
-            } else if (error == SOCKET_ERRNO_EINTR) {
-                SOSIMPLE_SOCKET_ERROR(SocketError::BrokenPipe, "Could not accept connection: "+errno2str(error))
             } else {
-                SOSIMPLE_SOCKET_ERROR(SocketError::Generic, "Could not accept connection: "+errno2str(error))
+                acceptFailed(error);
             }
-        } else if (!unblockSocket(fd)) {
-            POSIX_CLOSE(fd);
-            SOSIMPLE_SOCKET_ERROR(SocketError::Generic, "Could not unblock accepted socket");
         } else {
-            mWatchDog.reset();
-            notifyAccept(fd, Endpoint{(sockaddr*)&addr, addrSz});
+            accepted(fd, Endpoint{(sockaddr*)&addr, addrSz});
             acceptedSome = true;
         }
     }
     return acceptedSome;
 }
 
+auto
+sosimple::ListenSocketImpl::accepted(socket_t fd, Endpoint remote) -> void
+{
+    if (!unblockSocket(fd)) {
+        POSIX_CLOSE(fd);
+        SOSIMPLE_SOCKET_ERROR(SocketError::Generic, "Could not unblock accepted socket");
+    } else {
+        mWatchDog.reset(mReactor->getTime());
+        notifyAccept(fd, remote);
+    }
+}
+
+auto
+sosimple::ListenSocketImpl::acceptFailed(int error) -> void
+{
+    if (error == SOCKET_ERRNO_ECONNABORTED) {
+        return; // "a connection?"
+    } else if (error == SOCKET_ERRNO_ENOBUFS || error == SOCKET_ERRNO_ENOMEM) {
+        SOSIMPLE_SOCKET_ERROR(SocketError::NoMemory, "Could not accept connection: "+errno2str(error))
+    } else if (error == SOCKET_ERRNO_EMFILE || error == SOCKET_ERRNO_ENFILE) {
+        SOSIMPLE_SOCKET_ERROR(SocketError::HandleLimit, "Could not accept connection: "+errno2str(error))
+    } else if (error == SOCKET_ERRNO_EINTR) {
+        SOSIMPLE_SOCKET_ERROR(SocketError::BrokenPipe, "Could not accept connection: "+errno2str(error))
+    } else {
+        SOSIMPLE_SOCKET_ERROR(SocketError::Generic, "Could not accept connection: "+errno2str(error))
+    }
+}
+
 auto
 sosimple::ListenSocketImpl::checkWatchdog() -> void
 {
@@ -469,7 +532,7 @@ sosimple::ListenSocketImpl::notifyAccept(socket_t acceptedSocket, Endpoint remot
 {
     auto socket = createTCPServer(acceptedSocket, remote);
     if (Worker::isStarted()) {
-        sosimple::Worker::queue([wself=weak_from_this(),socket=socket,remote=remote](){
+        mStrand->post([wself=weak_from_this(),socket=socket,remote=remote](){
             auto self = std::dynamic_pointer_cast<ListenSocketImpl>(wself.lock());
             if (self) self->mAcceptEvent(socket, remote);
             return false;
@@ -486,7 +549,17 @@ sosimple::ListenSocketImpl::onAccept(AcceptCallback callback) -> void
 
 sosimple::ComSocketImpl::~ComSocketImpl()
 {
-    SocketPoller::get() -= mFD;
+    SocketPoller::get() -= *this;
+    if (mAssembly) releaseBuffer(mAssembly);
+    // the last look at the error queue, the descriptor is closed right after. pages the kernel still sends from
+    // stay borrowed
+    std::vector<SentCallback> finished;
+    {
+        std::unique_lock lock{mSendMutex};
+        if ((mFlags & SC_SOCKFLAG_CLOSED) == 0) reapZeroCopy(finished);
+        abandonSends(finished);
+    }
+    if (!finished.empty()) notifySent(std::move(finished));
 }
 
 auto
@@ -498,42 +571,382 @@ sosimple::ComSocketImpl::start() -> void
 auto
 sosimple::ComSocketImpl::read() -> bool
 {
-    uint8_t chunk[4096];
+    const bool datagrams = (mKind == Kind::UDP_Unicast || mKind == Kind::UDP_Multicast);
+    if (mStreaming && !datagrams)
+        return readStream();
+#if defined __linux__
+    if ((mFlags & SC_SOCKFLAG_COALESCED) != 0)
+        return readCoalesced();
+    if (datagrams)
+        return readBatch();
+#endif
     const bool connected = (mFlags & SC_SOCKFLAG_CONNECTED) != 0;
     bool readSomething{false};
+    // received straight into a pooled buffer, that is handed out as is
+    BufferBlock* block{nullptr};
+    on_exit finally([&](){ if (block) releaseBuffer(block); });
     while ((mFlags & SC_SOCKFLAG_CLOSED)==0) {
         int read;
         Endpoint from;
         sockaddr_storage addr{};
         socklen_t addrSz = sizeof(addr);
+        // datagrams are cut off at the buffer size, so they need room for the biggest one
+        size_t capacity = datagrams ? SC_LARGE_BUFFER_SIZE : mChunk;
+        if (block && block->capacity() < capacity) releaseBuffer(std::exchange(block, nullptr));
+        if (!block) block = acquireBuffer(capacity);
         if (connected) {
-            read = POSIX_RECV(mFD, chunk, sizeof(chunk), 0);
+            read = POSIX_RECV(mFD, block->data(), capacity, 0);
         } else {
-            read = POSIX_RECVFROM(mFD, chunk, sizeof(chunk), 0, (sockaddr*)&addr, &addrSz);
+            read = POSIX_RECVFROM(mFD, block->data(), capacity, 0, (sockaddr*)&addr, &addrSz);
         }
         int error = POSIX_ERRNO;
         if (read == -1) {
             if (error == SOCKET_ERRNO_EAGAIN || error == SOCKET_ERRNO_EWOULDBLOCK) {
                 break; // we've read everything available for now
-            } else if (error == SOCKET_ERRNO_ENOMEM) {
-                SOSIMPLE_SOCKET_ERROR(SocketError::NoMemory, "Could not read socket: "+errno2str(error))
-            } else if (error == SOCKET_ERRNO_EINTR || error == SOCKET_ERRNO_ECONNREFUSED || error == SOCKET_ERRNO_ENOTCONN) {
-                SOSIMPLE_SOCKET_ERROR(SocketError::BrokenPipe, "Could not read socket: "+errno2str(error))
-            } else {
-                SOSIMPLE_SOCKET_ERROR(SocketError::Generic, "Could not read socket: "+errno2str(error))
             }
+            readFailed(error);
         } else if (read>0) {
             if (connected)
                 from = mRemote;
             else
                 from = Endpoint{(sockaddr*)&addr, addrSz};
-            mWatchDog.reset();
-            notifyPacket(std::vector<uint8_t>(chunk+0, chunk+read), from);
+            if (!datagrams) adaptChunk(read);
+            if (block->large && read <= SC_BUFFER_BLOCK_SIZE)
+                received(copyBuffer(block->data(), read), from); // don't hold on to a large block for a few bytes
+            else
+                received(Buffer{std::exchange(block, nullptr), static_cast<size_t>(read)}, from);
+            readSomething = true;
+        } else if (mKind == Kind::TCP_Client || mKind == Kind::TCP_Server) {
+            // end of stream, otherwise we'd spin here forever after the remote hung up
+            readFailed(0);
+        }
+    }
+    return readSomething;
+}
+
+auto
+sosimple::ComSocketImpl::readStream() -> bool
+{
+    mFlags |= SC_SOCKFLAG_STREAM;
+    if (mReceiveBuffer < mStream->capacity()) {
+        // with the default receive buffer every read would return a few KiB, no matter how much room the ring has
+        int bufferSz = static_cast<int>(mStream->capacity());
+        POSIX_SETSOCKOPT(mFD, SOL_SOCKET, SO_RCVBUF, &bufferSz, sizeof(bufferSz));
+        mReceiveBuffer = mStream->capacity();
+    }
+    bool readSomething{false};
+    if (!mStreamBacklog.empty()) {
+        size_t copied = fillStream(mStreamBacklog.data(), mStreamBacklog.size());
+        mStreamBacklog.erase(mStreamBacklog.begin(), mStreamBacklog.begin() + static_cast<ptrdiff_t>(copied));
+        readSomething = copied > 0;
+    }
+    // received straight into the ring, the callback reads it from there
+    while (mStreamBacklog.empty() && (mFlags & SC_SOCKFLAG_CLOSED)==0) {
+        auto space = mStream->writable();
+        if (space.empty()) {
+            if (mStream->stall()) break; // the callback makes room and has the reactor resume us
+            continue;
+        }
+        int read = POSIX_RECV(mFD, space.data(), space.size(), 0);
+        int error = POSIX_ERRNO;
+        if (read == -1) {
+            if (error == SOCKET_ERRNO_EAGAIN || error == SOCKET_ERRNO_EWOULDBLOCK) {
+                break; // we've read everything available for now
+            }
+            readFailed(error);
+        } else if (read>0) {
+            mStream->commit(static_cast<size_t>(read));
+            readSomething = true;
+        } else {
+            readFailed(0); // end of stream
+        }
+    }
+    if (readSomething) {
+        mWatchDog.reset(mReactor->getTime());
+        notifyStream();
+    }
+    return readSomething;
+}
+
+auto
+sosimple::ComSocketImpl::fillStream(const uint8_t* data, size_t size) -> size_t
+{
+    size_t copied{0};
+    while (copied < size) {
+        auto space = mStream->writable();
+        if (space.empty()) {
+            if (mStream->stall()) break;
+            continue;
+        }
+        size_t count = std::min(space.size(), size - copied);
+        std::memcpy(space.data(), data + copied, count);
+        mStream->commit(count);
+        copied += count;
+    }
+    return copied;
+}
+
+#if defined __linux__
+auto
+sosimple::ComSocketImpl::readBatch() -> bool
+{
+    const bool connected = (mFlags & SC_SOCKFLAG_CONNECTED) != 0;
+    const unsigned batch = std::min<unsigned>(mReceiveBatch, SC_MAX_RECEIVE_BATCH);
+    bool readSomething{false};
+    BufferBlock* blocks[SC_MAX_RECEIVE_BATCH]{};
+    // large blocks that datagrams continue in, once they don't fit a regular block. only held while reading, the pool
+    // decides how many stay around
+    BufferBlock* overflow[SC_MAX_RECEIVE_BATCH]{};
+    on_exit finally([&](){
+        for (auto* block : blocks) if (block) releaseBuffer(block);
+        for (auto* block : overflow) if (block) releaseBuffer(block);
+    });
+    mmsghdr messages[SC_MAX_RECEIVE_BATCH];
+    iovec chunks[SC_MAX_RECEIVE_BATCH][2];
+    sockaddr_storage addrs[SC_MAX_RECEIVE_BATCH];
+    while ((mFlags & SC_SOCKFLAG_CLOSED)==0) {
+        for (unsigned i{0}; i < batch; i++) {
+            if (!blocks[i]) blocks[i] = acquireBuffer();
+            if (!overflow[i]) overflow[i] = acquireLargeBuffer();
+            // small datagrams fill the regular block, large ones continue behind the same offset in the large one
+            chunks[i][0] = {blocks[i]->data(), SC_BUFFER_BLOCK_SIZE};
+            chunks[i][1] = {overflow[i]->data() + SC_BUFFER_BLOCK_SIZE, SC_LARGE_BUFFER_SIZE - SC_BUFFER_BLOCK_SIZE};
+            messages[i] = {};
+            messages[i].msg_hdr.msg_name = &addrs[i];
+            messages[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+            messages[i].msg_hdr.msg_iov = chunks[i];
+            messages[i].msg_hdr.msg_iovlen = 2;
+        }
+        int count = ::recvmmsg(mFD, messages, batch, 0, nullptr);
+        int error = POSIX_ERRNO;
+        if (count == -1) {
+            if (error == SOCKET_ERRNO_EAGAIN || error == SOCKET_ERRNO_EWOULDBLOCK) {
+                break; // we've read everything available for now
+            }
+            readFailed(error);
+            continue;
+        }
+        for (int i{0}; i < count; i++) {
+            size_t size = messages[i].msg_len;
+            if ((messages[i].msg_hdr.msg_flags & MSG_TRUNC) != 0) {
+                mTruncated++;
+                continue;
+            }
+            if (size == 0) continue;
+            Endpoint from = connected ? mRemote : Endpoint{(sockaddr*)&addrs[i], messages[i].msg_hdr.msg_namelen};
+            if (size <= SC_BUFFER_BLOCK_SIZE) {
+                received(Buffer{std::exchange(blocks[i], nullptr), size}, from);
+            } else {
+                // copy the start over, to have the datagram in one piece. the regular block is used again
+                std::memcpy(overflow[i]->data(), blocks[i]->data(), SC_BUFFER_BLOCK_SIZE);
+                received(Buffer{std::exchange(overflow[i], nullptr), size}, from);
+            }
             readSomething = true;
         }
+        // a short batch means the queue is empty. datagrams that arrive later trigger another edge
+        if (static_cast<unsigned>(count) < batch) break;
     }
     return readSomething;
 }
+
+auto
+sosimple::ComSocketImpl::readCoalesced() -> bool
+{
+    bool readSomething{false};
+    BufferBlock* block{nullptr};
+    on_exit finally([&](){ if (block) releaseBuffer(block); });
+    alignas(cmsghdr) uint8_t control[CMSG_SPACE(sizeof(int))];
+    while ((mFlags & SC_SOCKFLAG_CLOSED)==0) {
+        if (!block) block = acquireLargeBuffer();
+        sockaddr_storage addr{};
+        iovec chunk{block->data(), SC_LARGE_BUFFER_SIZE};
+        msghdr message{};
+        message.msg_name = &addr;
+        message.msg_namelen = sizeof(addr);
+        message.msg_iov = &chunk;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        ssize_t read = ::recvmsg(mFD, &message, 0);
+        int error = POSIX_ERRNO;
+        if (read == -1) {
+            if (error == SOCKET_ERRNO_EAGAIN || error == SOCKET_ERRNO_EWOULDBLOCK) {
+                break; // we've read everything available for now
+            }
+            readFailed(error);
+            continue;
+        }
+        if ((message.msg_flags & MSG_TRUNC) != 0) {
+            mTruncated++;
+            continue;
+        }
+        if (read == 0) continue;
+        // without the segment size this was a single datagram
+        size_t segment = static_cast<size_t>(read);
+        for (cmsghdr* header = CMSG_FIRSTHDR(&message); header; header = CMSG_NXTHDR(&message, header)) {
+            if (header->cmsg_level == SOL_UDP && header->cmsg_type == UDP_GRO) {
+                int size;
+                std::memcpy(&size, CMSG_DATA(header), sizeof(size));
+                if (size > 0) segment = static_cast<size_t>(size);
+            }
+        }
+        Endpoint from = (mFlags & SC_SOCKFLAG_CONNECTED) ? mRemote : Endpoint{(sockaddr*)&addr, message.msg_namelen};
+        // every datagram is a slice of the same block, the last one might be shorter
+        Buffer merged{std::exchange(block, nullptr), static_cast<size_t>(read)};
+        for (size_t offset{0}; offset < merged.size(); offset += segment)
+            received(merged.slice(offset, segment), from);
+        readSomething = true;
+    }
+    return readSomething;
+}
+#endif
+
+auto
+sosimple::ComSocketImpl::received(Buffer data, Endpoint from) -> void
+{
+    mWatchDog.reset(mReactor->getTime());
+    if (mFramerChanged.exchange(false)) {
+        std::unique_lock lock{mFramerMutex};
+        mFramer = std::move(mNextFramer);
+        if (!mFramer && mAssembly) {
+            // framing is off, what was held back goes out as is
+            emit(Buffer{std::exchange(mAssembly, nullptr), std::exchange(mAssembled, 0)}, from);
+            mAssemblyCapacity = 0;
+        }
+    }
+    if (mFramer && (mKind == Kind::TCP_Client || mKind == Kind::TCP_Server))
+        unframe(std::move(data), from);
+    else
+        emit(std::move(data), from);
+}
+
+auto
+sosimple::ComSocketImpl::unframe(Buffer data, Endpoint from) -> void
+{
+    try {
+        // hand out every complete message as part of source. returns where the first incomplete one starts
+        auto split = [&](const Buffer& source) -> size_t {
+            size_t offset{0};
+            while (auto frame = mFramer->next(source.span().subspan(offset))) {
+                size_t length = frame->header + frame->size + frame->trailer;
+                if (length == 0 || length > source.size() - offset)
+                    throw socket_error(SocketError::Protocol, "Framer returned a frame outside the data");
+                emit(source.slice(offset + frame->header, frame->size), from);
+                offset += length;
+            }
+            return offset;
+        };
+        if (!mAssembly) {
+            // messages that came in whole are handed out without copying
+            size_t offset = split(data);
+            if (offset < data.size()) assemble(data.span().subspan(offset));
+            return;
+        }
+        assemble(data.span());
+        mAssembly->refs.fetch_add(1, std::memory_order_relaxed);
+        Buffer assembled{mAssembly, mAssembled};
+        size_t offset = split(assembled);
+        if (offset > 0) {
+            // the messages share the block now, the rest starts over in a new one
+            releaseBuffer(std::exchange(mAssembly, nullptr));
+            mAssembled = mAssemblyCapacity = 0;
+            if (offset < assembled.size()) assemble(assembled.span().subspan(offset));
+        }
+    } catch (socket_error& error) {
+        SOSIMPLE_SOCKET_ERROR(error.errcode(), std::string("Could not frame message: ") + error.what())
+    }
+}
+
+auto
+sosimple::ComSocketImpl::assemble(std::span<const uint8_t> bytes) -> void
+{
+    size_t needed = mAssembled + bytes.size();
+    if (!mAssembly || needed > mAssemblyCapacity) {
+        size_t capacity = std::max(needed, mAssemblyCapacity * 2);
+        if (capacity <= SC_BUFFER_BLOCK_SIZE) capacity = SC_BUFFER_BLOCK_SIZE;
+        else if (capacity <= SC_LARGE_BUFFER_SIZE) capacity = SC_LARGE_BUFFER_SIZE;
+        BufferBlock* block = acquireBuffer(capacity);
+        if (mAssembly) {
+            std::memcpy(block->data(), mAssembly->data(), mAssembled);
+            releaseBuffer(mAssembly);
+        }
+        mAssembly = block;
+        mAssemblyCapacity = capacity;
+    }
+    std::memcpy(mAssembly->data() + mAssembled, bytes.data(), bytes.size());
+    mAssembled = needed;
+}
+
+auto
+sosimple::ComSocketImpl::emit(Buffer data, Endpoint from) -> void
+{
+    if (mBatching) {
+        if (mBatch.empty()) mBatch.reserve(SC_DEFAULT_RECEIVE_BATCH);
+        mBatch.push_back({std::move(data), from});
+        if (mBatch.size() >= SC_MAX_PACKET_BATCH) flushReceived();
+    } else
+        notifyPacket(std::move(data), from);
+}
+
+auto
+sosimple::ComSocketImpl::flushReceived() -> void
+{
+    if (!mBatch.empty()) notifyPackets(std::exchange(mBatch, {}));
+}
+
+auto
+sosimple::ComSocketImpl::received(const uint8_t* data, size_t size, Endpoint from) -> void
+{
+    if (mStreaming && (mKind == Kind::TCP_Client || mKind == Kind::TCP_Server)) {
+        // the reactor switches to reading on readiness once it sees the flag, until then the ring takes copies.
+        // whatever doesn't fit waits in the backlog, after what was waiting there already
+        mFlags |= SC_SOCKFLAG_STREAM;
+        mWatchDog.reset(mReactor->getTime());
+        size_t copied = mStreamBacklog.empty() ? fillStream(data, size) : 0;
+        mStreamBacklog.insert(mStreamBacklog.end(), data + copied, data + size);
+        notifyStream();
+        return;
+    }
+    received(copyBuffer(data, size), from);
+}
+
+auto
+sosimple::ComSocketImpl::adaptChunk(size_t size) -> void
+{
+    size_t minimum = mMinChunk, maximum = mMaxChunk;
+    if (size >= mChunk)
+        mChunk = std::min(mChunk * 2, maximum); // there's probably more where that came from
+    else if (size <= mChunk / 4)
+        mChunk = std::max(mChunk / 2, minimum);
+    mChunk = std::clamp(mChunk, minimum, maximum); // in case the limits changed
+    if (mChunk > mReceiveBuffer && mChunk > SC_DEFAULT_BUFFER_SIZE) {
+        // the kernel never queues more than the receive buffer, reads wouldn't get any bigger otherwise
+        int bufferSz = static_cast<int>(mChunk);
+        if (POSIX_SETSOCKOPT(mFD, SOL_SOCKET, SO_RCVBUF, &bufferSz, sizeof(bufferSz)) == 0) mReceiveBuffer = mChunk;
+    }
+}
+
+auto
+sosimple::ComSocketImpl::truncated() -> void
+{
+    mTruncated++;
+}
+
+auto
+sosimple::ComSocketImpl::readFailed(int error) -> void
+{
+    flushReceived(); // what came before the error goes out first
+    if (mStreaming) notifyStream();
+    if (error == 0) {
+        SOSIMPLE_SOCKET_ERROR(SocketError::BrokenPipe, "Could not read socket: Connection closed by remote")
+    } else if (error == SOCKET_ERRNO_ENOMEM) {
+        SOSIMPLE_SOCKET_ERROR(SocketError::NoMemory, "Could not read socket: "+errno2str(error))
+    } else if (error == SOCKET_ERRNO_EINTR || error == SOCKET_ERRNO_ECONNREFUSED || error == SOCKET_ERRNO_ENOTCONN) {
+        SOSIMPLE_SOCKET_ERROR(SocketError::BrokenPipe, "Could not read socket: "+errno2str(error))
+    } else {
+        SOSIMPLE_SOCKET_ERROR(SocketError::Generic, "Could not read socket: "+errno2str(error))
+    }
+}
 auto
 sosimple::ComSocketImpl::checkWatchdog() -> void
 {
@@ -547,22 +960,141 @@ sosimple::ComSocketImpl::getRemoteEndpoint() const -> Endpoint
 }
 
 auto
-sosimple::ComSocketImpl::notifyPacket(const std::vector<uint8_t>& payload, Endpoint remote) -> void
+sosimple::ComSocketImpl::notifyPacket(Buffer payload, Endpoint remote) -> void
 {
     if (Worker::isStarted()) {
-        sosimple::Worker::queue([wself=weak_from_this(), payload=std::vector<uint8_t>(payload), remote=remote](){
+        mStrand->post([wself=weak_from_this(), payload=std::move(payload), remote=remote](){
             auto self = std::dynamic_pointer_cast<ComSocketImpl>(wself.lock());
-            if (self) self->mPacketReceivedEvent(payload, remote);
+            if (self) self->deliver(payload, remote);
             return false;
         });
     } else
-        mPacketReceivedEvent(payload, remote);
+        deliver(payload, remote);
+}
+
+auto
+sosimple::ComSocketImpl::notifyPackets(std::vector<Packet> packets) -> void
+{
+    if (Worker::isStarted()) {
+        mStrand->post([wself=weak_from_this(), packets=std::move(packets)](){
+            auto self = std::dynamic_pointer_cast<ComSocketImpl>(wself.lock());
+            if (self) self->deliver(packets);
+            return false;
+        });
+    } else
+        deliver(packets);
+}
+
+auto
+sosimple::ComSocketImpl::deliver(const Buffer& payload, Endpoint remote) -> void
+{
+    if (mBufferReceivedEvent)
+        mBufferReceivedEvent(payload, remote);
+    else if (mPacketReceivedEvent)
+        mPacketReceivedEvent(payload.toVector(), remote);
+    else if (mPacketsReceivedEvent)
+        mPacketsReceivedEvent({Packet{payload, remote}});
+}
+
+auto
+sosimple::ComSocketImpl::deliver(const std::vector<Packet>& packets) -> void
+{
+    if (mPacketsReceivedEvent) {
+        mPacketsReceivedEvent(packets);
+        return;
+    }
+    for (auto& packet : packets) deliver(packet.payload, packet.remote);
+}
+
+auto
+sosimple::ComSocketImpl::notifyStream() -> void
+{
+    if (mStreamNotified.exchange(true)) return;
+    if (Worker::isStarted()) {
+        mStrand->post([wself=weak_from_this()](){
+            auto self = std::dynamic_pointer_cast<ComSocketImpl>(wself.lock());
+            if (self) self->deliverStream();
+            return false;
+        });
+    } else
+        deliverStream();
+}
+
+auto
+sosimple::ComSocketImpl::deliverStream() -> void
+{
+    // cleared first, data that arrives while the callback runs gets another call
+    mStreamNotified = false;
+    if (mStreamEvent && mStream->available() > 0) mStreamEvent(*mStream);
+}
+
+auto
+sosimple::ComSocketImpl::onStream(StreamCallback callback, size_t capacity) -> void
+{
+    if (mKind != Kind::TCP_Client && mKind != Kind::TCP_Server) return;
+    mStreamEvent = callback;
+    if (mStreaming) return;
+    mStream = std::make_unique<StreamBuffer>(capacity);
+    mStream->mOnSpace = [wself=weak_from_this()](){
+        auto self = wself.lock();
+        if (self && self->mReactor) self->mReactor->resume(*self);
+    };
+    mStreaming = true;
+}
+
+auto
+sosimple::ComSocketImpl::setReceiveBatch(unsigned count) -> void
+{
+    mReceiveBatch = std::clamp(count, 1u, static_cast<unsigned>(SC_MAX_RECEIVE_BATCH));
+}
+
+auto
+sosimple::ComSocketImpl::setFramer(std::unique_ptr<Framer> framer) -> void
+{
+    std::unique_lock lock{mFramerMutex};
+    mNextFramer = std::move(framer);
+    mFramerChanged = true;
+}
+
+auto
+sosimple::ComSocketImpl::setReadChunkSize(size_t minimum, size_t maximum) -> void
+{
+    minimum = std::clamp<size_t>(minimum, 1, SC_MAX_READ_CHUNK);
+    mMaxChunk = std::clamp<size_t>(maximum, minimum, SC_MAX_READ_CHUNK);
+    mMinChunk = minimum;
+}
+
+auto
+sosimple::ComSocketImpl::getTruncatedCount() const -> uint64_t
+{
+    return mTruncated;
 }
 
 auto
 sosimple::ComSocketImpl::onPacket(PacketReceivedCallback callback) -> void
 {
     mPacketReceivedEvent = callback;
+    mBufferReceivedEvent = nullptr;
+    mPacketsReceivedEvent = nullptr;
+    mBatching = false;
+}
+
+auto
+sosimple::ComSocketImpl::onPacketBuffer(BufferReceivedCallback callback) -> void
+{
+    mBufferReceivedEvent = callback;
+    mPacketReceivedEvent = nullptr;
+    mPacketsReceivedEvent = nullptr;
+    mBatching = false;
+}
+
+auto
+sosimple::ComSocketImpl::onPackets(PacketsReceivedCallback callback) -> void
+{
+    mPacketsReceivedEvent = callback;
+    mPacketReceivedEvent = nullptr;
+    mBufferReceivedEvent = nullptr;
+    mBatching = static_cast<bool>(mPacketsReceivedEvent);
 }
 
 auto
@@ -574,33 +1106,696 @@ sosimple::ComSocketImpl::send(const std::vector<uint8_t>& payload, Endpoint remo
     }
 
     int result; int error;
+    size_t segment = mSegmentSize;
     if (mKind == Kind::UDP_Multicast) {
         sockaddr_storage addr{};
         mRemote.toSockaddrStorage(addr);
+        if (segment > 0 && payload.size() > segment) {
+            sendSegments(payload, addr, mRemote);
+            return;
+        }
         result = POSIX_SENDTO(mFD, payload.data(), payload.size(), 0, (sockaddr*)&addr, sizeof(addr));
         error = POSIX_ERRNO;
     } else if (mKind == Kind::UDP_Unicast) {
         sockaddr_storage addr{};
         remote.toSockaddrStorage(addr);
+        if (segment > 0 && payload.size() > segment) {
+            sendSegments(payload, addr, remote);
+            return;
+        }
         result = POSIX_SENDTO(mFD, payload.data(), payload.size(), 0, (sockaddr*)&addr, sizeof(addr));
         error = POSIX_ERRNO;
     } else {
-        result = POSIX_SEND(mFD, payload.data(), payload.size(), 0);
+        // unlike an empty datagram, an empty stream send is nothing at all
+        if (payload.empty()) return;
+        std::span<const uint8_t> part{payload};
+        sendStream({&part, 1});
+        return;
+    }
+    if (result == -1 && error != SOCKET_ERRNO_EAGAIN && error != SOCKET_ERRNO_EWOULDBLOCK)
+        sendFailed(error);
+}
+
+auto
+sosimple::ComSocketImpl::send(std::span<const std::span<const uint8_t>> parts, Endpoint remote) const -> void
+{
+    if ((mFlags & SC_SOCKFLAG_CLOSED)!=0) {
+        notifySocketError(socket_error(SocketError::BrokenPipe, "Can not send message: Socket was closed"));
+        return;
+    }
+    if (mKind != Kind::UDP_Unicast && mKind != Kind::UDP_Multicast) {
+        sendStream(parts);
+        return;
+    }
+#if defined __linux__
+    if (parts.size() <= SC_MAX_SEND_IOV) {
+        iovec gather[SC_MAX_SEND_IOV];
+        for (size_t i{0}; i < parts.size(); i++) gather[i] = {const_cast<uint8_t*>(parts[i].data()), parts[i].size()};
+        sockaddr_storage addr{};
+        ((mKind == Kind::UDP_Multicast) ? mRemote : remote).toSockaddrStorage(addr);
+        msghdr message{};
+        message.msg_name = &addr;
+        message.msg_namelen = sizeof(addr);
+        message.msg_iov = gather;
+        message.msg_iovlen = parts.size();
+        int result = ::sendmsg(mFD, &message, 0);
+        int error = POSIX_ERRNO;
+        if (result == -1 && error != SOCKET_ERRNO_EAGAIN && error != SOCKET_ERRNO_EWOULDBLOCK)
+            sendFailed(error);
+        return;
+    }
+#endif
+    // no gather send for datagrams here, put them together after all
+    std::vector<uint8_t> payload;
+    for (auto& part : parts) payload.insert(payload.end(), part.begin(), part.end());
+    send(payload, remote);
+}
+
+auto
+sosimple::ComSocketImpl::sendStream(std::span<const std::span<const uint8_t>> parts) const -> void
+{
+    size_t size{0};
+    for (auto& part : parts) size += part.size();
+    std::unique_lock lock{mSendMutex};
+    size_t sent{0};
+    if (mSendQueue.empty()) {
+        // nothing to wait for, straight to the kernel. parts go out together as long as the kernel takes all of them
+        for (size_t index{0}; index < parts.size(); ) {
+#if defined __linux__
+            iovec gather[SC_MAX_SEND_IOV];
+            size_t count{0}, bytes{0};
+            for (; count < SC_MAX_SEND_IOV && index + count < parts.size(); count++) {
+                gather[count] = {const_cast<uint8_t*>(parts[index + count].data()), parts[index + count].size()};
+                bytes += parts[index + count].size();
+            }
+            msghdr message{};
+            message.msg_iov = gather;
+            message.msg_iovlen = count;
+            auto result = (count == 1) ? POSIX_SEND(mFD, gather[0].iov_base, bytes, 0) : ::sendmsg(mFD, &message, 0);
+#else
+            size_t count{1}, bytes{parts[index].size()};
+            auto result = POSIX_SEND(mFD, parts[index].data(), bytes, 0);
+#endif
+            int error = POSIX_ERRNO;
+            if (result == -1) {
+                if (error == SOCKET_ERRNO_EAGAIN || error == SOCKET_ERRNO_EWOULDBLOCK) break;
+                lock.unlock();
+                sendFailed(error);
+                return;
+            }
+            sent += static_cast<size_t>(result);
+            if (static_cast<size_t>(result) < bytes) break;
+            index += count;
+        }
+    }
+    // nothing left for the queue. an empty entry would never go out
+    if (size - sent == 0) return;
+    bool waiting = !mSendQueue.empty() || !mZeroCopySends.empty();
+    // with the default send buffer the queue would go out a few KiB per round trip
+    growSendBuffer(mHighWatermark);
+    // the rest of the parts goes into one buffer
+    BufferBlock* block = acquireBuffer(size - sent);
+    size_t queued{0}, skip{sent};
+    for (auto& part : parts) {
+        if (skip >= part.size()) {
+            skip -= part.size();
+            continue;
+        }
+        std::memcpy(block->data() + queued, part.data() + skip, part.size() - skip);
+        queued += part.size() - skip;
+        skip = 0;
+    }
+    mSendQueue.push_back({Buffer{block, queued}});
+    mQueued += queued;
+    if (mQueued > mHighWatermark) mAboveHigh = true;
+    lock.unlock();
+    // the poll thread flushes the queue from now on, until it's empty again
+    if (!waiting && mReactor) mReactor->awaitWritable(*this);
+}
+
+auto
+sosimple::ComSocketImpl::flush() -> bool
+{
+    // no shortcut on mQueued without the lock: a send that just filled the socket might not have queued the rest yet,
+    // and the edge that says it's writable again would be gone by the time it did
+    std::unique_lock lock{mSendMutex};
+    int error{0};
+    while (!mSendQueue.empty() && (mFlags & SC_SOCKFLAG_CLOSED)==0) {
+        Outgoing& front = mSendQueue.front();
+        int64_t result;
+        if (!front.borrowed.empty()) {
+            result = sendBorrowed(front.borrowed.subspan(mSendOffset), true, front.sent, error);
+#if defined __linux__
+        } else if (front.file.fd >= 0) {
+            result = sendFileRange(front.file.fd, front.file.offset + mSendOffset, front.file.size - mSendOffset, error);
+#endif
+        } else {
+#if defined __linux__
+            // everything copied into the queue in one go, as far as the kernel takes it
+            iovec parts[SC_MAX_SEND_IOV];
+            size_t count{0};
+            for (auto& outgoing : mSendQueue) {
+                if (count == SC_MAX_SEND_IOV || !outgoing.borrowed.empty() || outgoing.file.fd >= 0) break;
+                size_t skip = (count == 0) ? mSendOffset : 0;
+                parts[count++] = {const_cast<uint8_t*>(outgoing.owned.data()) + skip, outgoing.owned.size() - skip};
+            }
+            msghdr message{};
+            message.msg_iov = parts;
+            message.msg_iovlen = count;
+            result = ::sendmsg(mFD, &message, 0);
+#else
+            result = POSIX_SEND(mFD, front.owned.data() + mSendOffset, front.owned.size() - mSendOffset, 0);
+#endif
+            if (result == -1) error = POSIX_ERRNO;
+        }
+        if (result == -1) {
+            if (error == SOCKET_ERRNO_EAGAIN || error == SOCKET_ERRNO_EWOULDBLOCK) error = 0;
+            break;
+        }
+        size_t sent = static_cast<size_t>(result);
+        mQueued -= sent;
+        // empty entries at the front are done with any result, they'd send nothing forever
+        while (!mSendQueue.empty()) {
+            size_t left = mSendQueue.front().size() - mSendOffset;
+            if (sent < left) {
+                mSendOffset += sent;
+                break;
+            }
+            sent -= left;
+            mSendQueue.pop_front();
+            mSendOffset = 0;
+        }
+    }
+    std::vector<SentCallback> finished;
+    const bool closed = (mFlags & SC_SOCKFLAG_CLOSED) != 0;
+    // the error queue is gone with the descriptor
+    if (!closed) reapZeroCopy(finished);
+    if (error != 0 || closed) abandonSends(finished);
+    bool drained = mSendQueue.empty() && mZeroCopySends.empty();
+    bool resume = mAboveHigh && mQueued <= mLowWatermark;
+    if (resume) mAboveHigh = false;
+    // callbacks might send right away
+    lock.unlock();
+    if (!finished.empty()) notifySent(std::move(finished));
+    if (error != 0) sendFailed(error);
+    else if (resume) notifyWritable();
+    return drained;
+}
+
+auto
+sosimple::ComSocketImpl::sendBatch(std::span<const Datagram> datagrams) const -> size_t
+{
+    if ((mFlags & SC_SOCKFLAG_CLOSED)!=0) {
+        notifySocketError(socket_error(SocketError::BrokenPipe, "Can not send message: Socket was closed"));
+        return 0;
+    }
+    if (mKind != Kind::UDP_Unicast && mKind != Kind::UDP_Multicast) {
+        // the send queue takes whatever the kernel doesn't
+        for (auto& datagram : datagrams) sendStream({&datagram.payload, 1});
+        return datagrams.size();
+    }
+    {
+        // with the default send buffer all but the first few datagrams of a batch would be dropped
+        std::unique_lock lock{mSendMutex};
+        growSendBuffer(SC_DEFAULT_SEND_HIGH_WATERMARK);
+    }
+#if defined __linux__
+    struct Batch {
+        std::vector<mmsghdr> headers;
+        std::vector<iovec> parts;
+        std::vector<sockaddr_storage> names;
+    };
+    thread_local Batch batch{};
+    for (size_t offset{0}; offset < datagrams.size(); ) {
+        size_t count = std::min<size_t>(datagrams.size() - offset, SC_MAX_SEND_BATCH);
+        if (batch.headers.size() < count) {
+            batch.headers.resize(count);
+            batch.parts.resize(count);
+            batch.names.resize(count);
+        }
+        for (size_t i{0}; i < count; i++) {
+            const Datagram& datagram = datagrams[offset + i];
+            const Endpoint& remote = (mKind == Kind::UDP_Multicast) ? mRemote : datagram.remote;
+            // fan-out goes to many remotes, bursts to one remote only need the address once
+            if (i == 0 || (mKind != Kind::UDP_Multicast && !(remote == datagrams[offset + i - 1].remote))) {
+                batch.names[i] = sockaddr_storage{};
+                remote.toSockaddrStorage(batch.names[i]);
+            } else {
+                batch.names[i] = batch.names[i - 1];
+            }
+            batch.parts[i] = {const_cast<uint8_t*>(datagram.payload.data()), datagram.payload.size()};
+            batch.headers[i] = mmsghdr{};
+            batch.headers[i].msg_hdr.msg_name = &batch.names[i];
+            batch.headers[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+            batch.headers[i].msg_hdr.msg_iov = &batch.parts[i];
+            batch.headers[i].msg_hdr.msg_iovlen = 1;
+        }
+        for (size_t sent{0}; sent < count; ) {
+            int result = ::sendmmsg(mFD, batch.headers.data() + sent, static_cast<unsigned>(count - sent), 0);
+            int error = POSIX_ERRNO;
+            if (result == -1) {
+                // a full send buffer drops the rest, the caller decides whether to try again later
+                if (error != SOCKET_ERRNO_EAGAIN && error != SOCKET_ERRNO_EWOULDBLOCK) sendFailed(error);
+                return offset + sent;
+            }
+            sent += static_cast<size_t>(result);
+        }
+        offset += count;
+    }
+    return datagrams.size();
+#else
+    for (size_t sent{0}; sent < datagrams.size(); sent++) {
+        const Datagram& datagram = datagrams[sent];
+        sockaddr_storage addr{};
+        ((mKind == Kind::UDP_Multicast) ? mRemote : datagram.remote).toSockaddrStorage(addr);
+        int result = POSIX_SENDTO(mFD, datagram.payload.data(), datagram.payload.size(), 0, (sockaddr*)&addr, sizeof(addr));
+        int error = POSIX_ERRNO;
+        if (result == -1) {
+            if (error != SOCKET_ERRNO_EAGAIN && error != SOCKET_ERRNO_EWOULDBLOCK) sendFailed(error);
+            return sent;
+        }
+    }
+    return datagrams.size();
+#endif
+}
+
+auto
+sosimple::ComSocketImpl::sendSegments(std::span<const uint8_t> payload, const sockaddr_storage& addr, const Endpoint& remote) const -> void
+{
+    size_t segment = mSegmentSize;
+    if (segment == 0) segment = payload.size(); // turned off in the meantime
+#if defined __linux__ && defined UDP_SEGMENT
+    if (mKernelSegments) {
+        // the kernel takes whole segments only, and no more than fit a single datagram
+        size_t most = segment * std::max<size_t>(std::min<size_t>(SC_MAX_SEGMENTS, SC_MAX_DATAGRAM_SIZE / segment), 1);
+        size_t offset{0};
+        // the segment size goes with each send, the socket itself keeps sending datagrams as they are
+        alignas(cmsghdr) uint8_t control[CMSG_SPACE(sizeof(uint16_t))]{};
+        auto gso = static_cast<uint16_t>(segment);
+        msghdr message{};
+        message.msg_name = const_cast<sockaddr_storage*>(&addr);
+        message.msg_namelen = sizeof(addr);
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        cmsghdr* header = CMSG_FIRSTHDR(&message);
+        header->cmsg_level = SOL_UDP;
+        header->cmsg_type = UDP_SEGMENT;
+        header->cmsg_len = CMSG_LEN(sizeof(gso));
+        std::memcpy(CMSG_DATA(header), &gso, sizeof(gso));
+        while (offset < payload.size()) {
+            size_t size = std::min(most, payload.size() - offset);
+            iovec part{const_cast<uint8_t*>(payload.data()) + offset, size};
+            message.msg_iov = &part;
+            message.msg_iovlen = 1;
+            int result = ::sendmsg(mFD, &message, 0);
+            int error = POSIX_ERRNO;
+            if (result == -1) {
+                if (error == SOCKET_ERRNO_EAGAIN || error == SOCKET_ERRNO_EWOULDBLOCK) return; // the rest is dropped
+                // EIO: the device can't checksum segments. split them ourselves from now on
+                if (error != EIO) {
+                    sendFailed(error);
+                    return;
+                }
+                mKernelSegments = false;
+                break;
+            }
+            offset += size;
+        }
+        if (offset == payload.size()) return;
+        payload = payload.subspan(offset);
+    }
+#endif
+    std::vector<Datagram> datagrams;
+    datagrams.reserve((payload.size() + segment - 1) / segment);
+    for (size_t offset{0}; offset < payload.size(); offset += segment)
+        datagrams.push_back({payload.subspan(offset, std::min(segment, payload.size() - offset)), remote});
+    sendBatch(datagrams);
+}
+
+auto
+sosimple::ComSocketImpl::setSegmentSize(uint16_t size) -> void
+{
+    if (mKind != Kind::UDP_Unicast && mKind != Kind::UDP_Multicast) return;
+    // a segment has to fit a datagram, larger sends would fail with EMSGSIZE and close the socket
+    size = static_cast<uint16_t>(std::min<size_t>(size, SC_MAX_DATAGRAM_SIZE));
+    bool kernel{false};
+#if defined __linux__ && defined UDP_SEGMENT
+    // only a probe. set on the socket it would apply to gather sends and batches as well, so sendSegments passes the
+    // size along with each send instead
+    int value = size;
+    kernel = size > 0 && POSIX_SETSOCKOPT(mFD, SOL_UDP, UDP_SEGMENT, &value, sizeof(value)) == 0;
+    if (kernel) {
+        value = 0;
+        POSIX_SETSOCKOPT(mFD, SOL_UDP, UDP_SEGMENT, &value, sizeof(value));
+    }
+#endif
+    mSegmentSize = size;
+    mKernelSegments = kernel;
+    if (size > 0) {
+        // a segmented send fills the default send buffer all by itself
+        std::unique_lock lock{mSendMutex};
+        growSendBuffer(SC_DEFAULT_SEND_HIGH_WATERMARK);
+    }
+}
+
+auto
+sosimple::ComSocketImpl::growSendBuffer(size_t size) const -> void
+{
+    if (mSendBuffer >= size) return;
+    int bufferSz = static_cast<int>(std::min<size_t>(size, INT_MAX));
+    POSIX_SETSOCKOPT(mFD, SOL_SOCKET, SO_SNDBUF, &bufferSz, sizeof(bufferSz));
+    mSendBuffer = size;
+}
+
+auto
+sosimple::ComSocketImpl::sendZeroCopy(std::span<const uint8_t> payload, SentCallback sent, Endpoint remote) const -> void
+{
+    if ((mFlags & SC_SOCKFLAG_CLOSED)!=0) {
+        notifySocketError(socket_error(SocketError::BrokenPipe, "Can not send message: Socket was closed"));
+        sentLater(std::move(sent));
+        return;
+    }
+    const bool datagrams = (mKind == Kind::UDP_Unicast || mKind == Kind::UDP_Multicast);
+    std::unique_lock lock{mSendMutex};
+    if (datagrams || payload.size() < SC_MIN_ZEROCOPY_SIZE || !enableZeroCopy()) {
+        lock.unlock();
+        send(std::span<const std::span<const uint8_t>>{&payload, 1}, remote);
+        sentLater(std::move(sent));
+        return;
+    }
+    bool waiting = !mSendQueue.empty() || !mZeroCopySends.empty();
+    size_t offset{0};
+    if (mSendQueue.empty()) {
+        while (offset < payload.size()) {
+            int error{0};
+            auto result = sendBorrowed(payload.subspan(offset), true, sent, error);
+            if (result == -1) {
+                if (error == SOCKET_ERRNO_EAGAIN || error == SOCKET_ERRNO_EWOULDBLOCK) break;
+                lock.unlock();
+                sendFailed(error);
+                sentLater(std::move(sent));
+                return;
+            }
+            offset += static_cast<size_t>(result);
+        }
+    }
+    if (offset < payload.size()) {
+        growSendBuffer(mHighWatermark);
+        mSendQueue.push_back({Buffer{}, payload.subspan(offset), std::move(sent)});
+        mQueued += payload.size() - offset;
+        if (mQueued > mHighWatermark) mAboveHigh = true;
+    }
+    // sends the kernel copied after all are done already
+    std::vector<SentCallback> finished;
+    reapZeroCopy(finished);
+    bool idle = mSendQueue.empty() && mZeroCopySends.empty();
+    lock.unlock();
+    if (!finished.empty()) notifySent(std::move(finished));
+    // the poll thread flushes the queue and collects the completions from now on
+    if (!waiting && !idle && mReactor) mReactor->awaitWritable(*this);
+}
+
+auto
+sosimple::ComSocketImpl::sendFile(int file, uint64_t offset, size_t length) const -> void
+{
+    if ((mFlags & SC_SOCKFLAG_CLOSED)!=0) {
+        notifySocketError(socket_error(SocketError::BrokenPipe, "Can not send file: Socket was closed"));
+        return;
+    }
+    if (mKind == Kind::UDP_Unicast || mKind == Kind::UDP_Multicast) {
+        notifySocketError(socket_error(SocketError::Configuration, "Can not send file: Not a tcp socket"));
+        return;
+    }
+    if (length == 0) return;
+#if defined __linux__
+    std::unique_lock lock{mSendMutex};
+    bool waiting = !mSendQueue.empty() || !mZeroCopySends.empty();
+    size_t sent{0};
+    int error{0};
+    if (mSendQueue.empty()) {
+        // nothing to wait for, straight to the kernel
+        while (sent < length) {
+            auto result = sendFileRange(file, offset + sent, length - sent, error);
+            if (result == -1) break;
+            sent += static_cast<size_t>(result);
+        }
+    }
+    if (error != 0 && error != SOCKET_ERRNO_EAGAIN && error != SOCKET_ERRNO_EWOULDBLOCK) {
+        lock.unlock();
+        sendFailed(error);
+        return;
+    }
+    if (sent == length) return;
+    int duplicate = ::fcntl(file, F_DUPFD_CLOEXEC, 0);
+    if (duplicate == -1) {
         error = POSIX_ERRNO;
+        lock.unlock();
+        sendFailed(error);
+        return;
+    }
+    growSendBuffer(mHighWatermark);
+    mSendQueue.push_back({Buffer{}, {}, {}, FileRange{duplicate, offset + sent, length - sent}});
+    mQueued += length - sent;
+    if (mQueued > mHighWatermark) mAboveHigh = true;
+    lock.unlock();
+    // the poll thread flushes the queue from now on, until it's empty again
+    if (!waiting && mReactor) mReactor->awaitWritable(*this);
+#else
+    // no sendfile, the file goes through memory after all
+    std::vector<uint8_t> content(length);
+    size_t read{0};
+    if (::_lseeki64(file, static_cast<int64_t>(offset), SEEK_SET) != -1) {
+        while (read < length) {
+            int result = ::_read(file, content.data() + read, static_cast<unsigned>(std::min<size_t>(length - read, INT_MAX)));
+            if (result <= 0) break;
+            read += static_cast<size_t>(result);
+        }
     }
+    if (read < length) {
+        notifySocketError(socket_error(SocketError::Generic, "Can not send file: Could not read it"));
+        return;
+    }
+    send(content);
+#endif
+}
+
+#if defined __linux__
+auto
+sosimple::ComSocketImpl::sendFileRange(int file, uint64_t offset, size_t size, int& error) const -> int64_t
+{
+    off_t from = static_cast<off_t>(offset);
+    auto result = ::sendfile(mFD, file, &from, size);
     if (result == -1) {
-        if (error == SOCKET_ERRNO_EAGAIN || error == SOCKET_ERRNO_EWOULDBLOCK) {
-            /* pass */
-        } else if (error == SOCKET_ERRNO_EACCES) {
-            SOSIMPLE_SOCKET_ERROR(SocketError::Permission, "Could not send on socket: "+errno2str(error))
-        } else if (error == SOCKET_ERRNO_ENOBUFS || error == SOCKET_ERRNO_ENOMEM || error == SOCKET_ERRNO_EMSGSIZE) {
-            SOSIMPLE_SOCKET_ERROR(SocketError::NoMemory, "Could not send on socket: "+errno2str(error))
-        } else if (error == SOCKET_ERRNO_ECONNRESET || error == SOCKET_ERRNO_ENOTCONN || error == SOCKET_ERRNO_EPIPE) {
-            SOSIMPLE_SOCKET_ERROR(SocketError::BrokenPipe, "Could not send on socket: "+errno2str(error))
-        } else if (error == SOCKET_ERRNO_EDESTADDRREQ || error == SOCKET_ERRNO_EISCONN || error == SOCKET_ERRNO_EPIPE) {
-            SOSIMPLE_SOCKET_ERROR(SocketError::Configuration, "Could not send on socket: "+errno2str(error))
-        } else {
-            SOSIMPLE_SOCKET_ERROR(SocketError::Generic, "Could not send on socket: "+errno2str(error))
+        error = POSIX_ERRNO;
+        return -1;
+    }
+    if (result == 0) {
+        // the file is shorter than promised, the stream can't be completed
+        error = ENODATA;
+        return -1;
+    }
+    return result;
+}
+#endif
+
+sosimple::ComSocketImpl::FileRange::~FileRange()
+{
+#if defined __linux__
+    if (fd >= 0) ::close(fd);
+#endif
+}
+
+auto
+sosimple::ComSocketImpl::FileRange::operator=(FileRange&& other) noexcept -> FileRange&
+{
+    std::swap(fd, other.fd);
+    offset = other.offset;
+    size = other.size;
+    return *this;
+}
+
+auto
+sosimple::ComSocketImpl::enableZeroCopy() const -> bool
+{
+#if defined __linux__ && defined MSG_ZEROCOPY
+    if (!mZeroCopyTried) {
+        mZeroCopyTried = true;
+        int one{1};
+        mZeroCopy = POSIX_SETSOCKOPT(mFD, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0;
+    }
+#endif
+    return mZeroCopy;
+}
+
+auto
+sosimple::ComSocketImpl::sendBorrowed(std::span<const uint8_t> bytes, bool last, SentCallback& sent, int& error) const
+-> int64_t
+{
+#if defined __linux__ && defined MSG_ZEROCOPY
+    if (mZeroCopy) {
+        auto result = ::send(mFD, bytes.data(), bytes.size(), MSG_ZEROCOPY);
+        if (result != -1) {
+            bool whole = last && static_cast<size_t>(result) == bytes.size();
+            mZeroCopySends.push_back({mZeroCopyNext++, false, whole ? std::move(sent) : SentCallback{}});
+            return result;
+        }
+        int refused = POSIX_ERRNO;
+        // ENOBUFS: more pages pinned than the locked memory limit allows, this one is copied. the caller only
+        // gets to see an error of the copying send then
+        if (refused != SOCKET_ERRNO_ENOBUFS) {
+            error = refused;
+            return -1;
         }
     }
-}
\ No newline at end of file
+#endif
+    auto result = POSIX_SEND(mFD, bytes.data(), bytes.size(), 0);
+    if (result == -1) {
+        error = POSIX_ERRNO;
+        return -1;
+    }
+    // copied, but earlier parts of the payload might still be in flight
+    if (last && static_cast<size_t>(result) == bytes.size()) mZeroCopySends.push_back({0, true, std::move(sent)});
+    return result;
+}
+
+auto
+sosimple::ComSocketImpl::reapZeroCopy(std::vector<SentCallback>& finished) const -> void
+{
+    // completions can be reported out of order, a payload is only released once everything before it is
+    auto release = [&](){
+        while (!mZeroCopySends.empty() && mZeroCopySends.front().done) {
+            if (mZeroCopySends.front().sent) finished.push_back(std::move(mZeroCopySends.front().sent));
+            mZeroCopySends.pop_front();
+        }
+        return !mZeroCopySends.empty();
+    };
+#if defined __linux__ && defined MSG_ZEROCOPY
+    while (release()) {
+        alignas(cmsghdr) uint8_t control[128];
+        msghdr message{};
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        if (::recvmsg(mFD, &message, MSG_ERRQUEUE) == -1) break;
+        for (cmsghdr* header = CMSG_FIRSTHDR(&message); header; header = CMSG_NXTHDR(&message, header)) {
+            if (!(header->cmsg_level == SOL_IP && header->cmsg_type == IP_RECVERR)
+                && !(header->cmsg_level == SOL_IPV6 && header->cmsg_type == IPV6_RECVERR)) continue;
+            sock_extended_err report;
+            std::memcpy(&report, CMSG_DATA(header), sizeof(report));
+            if (report.ee_origin != SO_EE_ORIGIN_ZEROCOPY || report.ee_errno != 0) continue;
+            // the sends from ee_info to ee_data are done. copied means the device can't send from user pages
+            // (e.g. loopback), then pinning them is wasted
+            if ((report.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) != 0) mZeroCopy = false;
+            for (auto& zeroCopy : mZeroCopySends)
+                if (zeroCopy.id - report.ee_info <= report.ee_data - report.ee_info) zeroCopy.done = true;
+        }
+    }
+#else
+    release();
+#endif
+}
+
+auto
+sosimple::ComSocketImpl::abandonSends(std::vector<SentCallback>& finished) const -> void
+{
+    // a payload is done once all of its sends are, its callback sits on the last one. done payloads go back even
+    // behind one that isn't, nothing is waiting for the order anymore
+    bool whole{true};
+    for (auto& zeroCopy : mZeroCopySends) {
+        whole = whole && zeroCopy.done;
+        if (!zeroCopy.sent) continue;
+        if (whole) finished.push_back(std::move(zeroCopy.sent));
+        whole = true;
+    }
+    // sends without a callback at the end belong to the front of the queue, the rest never reached the kernel
+    for (size_t index{0}; index < mSendQueue.size(); index++) {
+        bool started = index == 0 && mSendOffset > 0 && !mSendQueue[index].borrowed.empty();
+        if (mSendQueue[index].sent && (whole || !started)) finished.push_back(std::move(mSendQueue[index].sent));
+    }
+    mSendQueue.clear();
+    mZeroCopySends.clear();
+    mSendOffset = 0;
+    mQueued = 0;
+}
+
+auto
+sosimple::ComSocketImpl::sentLater(SentCallback sent) const -> void
+{
+    if (!sent) return;
+    if (Worker::isStarted()) {
+        notifySent({std::move(sent)});
+        return;
+    }
+    // nothing flushes a closed socket or one no reactor polls, there's no later to wait for
+    if ((mFlags & SC_SOCKFLAG_CLOSED) != 0 || !mReactor) {
+        sent();
+        return;
+    }
+    // callbacks without a worker run on the poll thread, the next flush hands this one out
+    {
+        std::unique_lock lock{mSendMutex};
+        mZeroCopySends.push_back({0, true, std::move(sent)});
+    }
+    if (mReactor) mReactor->resume(const_cast<ComSocketImpl&>(*this));
+}
+
+auto
+sosimple::ComSocketImpl::notifySent(std::vector<SentCallback> finished) const -> void
+{
+    // the callbacks don't need the socket, they may run after it's gone
+    if (Worker::isStarted()) {
+        mStrand->post([finished=std::move(finished)](){
+            for (auto& sent : finished) sent();
+            return false;
+        });
+    } else {
+        for (auto& sent : finished) sent();
+    }
+}
+
+auto
+sosimple::ComSocketImpl::sendFailed(int error) const -> void
+{
+    if (error == SOCKET_ERRNO_EACCES) {
+        SOSIMPLE_SOCKET_ERROR(SocketError::Permission, "Could not send on socket: "+errno2str(error))
+    } else if (error == SOCKET_ERRNO_ENOBUFS || error == SOCKET_ERRNO_ENOMEM || error == SOCKET_ERRNO_EMSGSIZE) {
+        SOSIMPLE_SOCKET_ERROR(SocketError::NoMemory, "Could not send on socket: "+errno2str(error))
+    } else if (error == SOCKET_ERRNO_ECONNRESET || error == SOCKET_ERRNO_ENOTCONN || error == SOCKET_ERRNO_EPIPE) {
+        SOSIMPLE_SOCKET_ERROR(SocketError::BrokenPipe, "Could not send on socket: "+errno2str(error))
+    } else if (error == SOCKET_ERRNO_EDESTADDRREQ || error == SOCKET_ERRNO_EISCONN || error == SOCKET_ERRNO_EPIPE) {
+        SOSIMPLE_SOCKET_ERROR(SocketError::Configuration, "Could not send on socket: "+errno2str(error))
+    } else {
+        SOSIMPLE_SOCKET_ERROR(SocketError::Generic, "Could not send on socket: "+errno2str(error))
+    }
+}
+
+auto
+sosimple::ComSocketImpl::notifyWritable() -> void
+{
+    if (Worker::isStarted()) {
+        mStrand->post([wself=weak_from_this()](){
+            auto self = std::dynamic_pointer_cast<ComSocketImpl>(wself.lock());
+            if (self && self->mWritableEvent) self->mWritableEvent();
+            return false;
+        });
+    } else if (mWritableEvent)
+        mWritableEvent();
+}
+
+auto
+sosimple::ComSocketImpl::getSendQueueSize() const -> size_t
+{
+    return mQueued;
+}
+
+auto
+sosimple::ComSocketImpl::setSendWatermarks(size_t high, size_t low) -> void
+{
+    mHighWatermark = high;
+    mLowWatermark = std::min(low, high);
+}
+
+auto
+sosimple::ComSocketImpl::onWritable(WritableCallback callback) -> void
+{
+    mWritableEvent = callback;
+}
@@ -2,13 +2,53 @@
 #define SOSIMPLE_SOCKET_IMPL_HPP
 
 #include "watchdog.hpp"
+#include "timer_wheel.hpp"
+#include "strand.hpp"
 #include <sosimple/socket.hpp>
 #include <memory>
 #include <atomic>
+#include <deque>
+#include <mutex>
 #include <thread>
+#include <utility>
+
+/// mark socket as connected. a connected socket does not accept a remote argument when sending
+#define SC_SOCKFLAG_CONNECTED 1
+/// flag a socket as closed: whether is has been opened or not, this socket is dead
+#define SC_SOCKFLAG_CLOSED 2
+/// udp socket with UDP_GRO enabled, a single receive can return many datagrams that have to be split up again
+#define SC_SOCKFLAG_COALESCED 4
+/// udp socket got datagrams that were too big for the io_uring buffers, it's read on readiness from then on
+#define SC_SOCKFLAG_LARGE_DATAGRAMS 8
+/// tcp socket that receives into a StreamBuffer, it's read on readiness on the io_uring backend as well
+#define SC_SOCKFLAG_STREAM 16
+
+/// datagrams read per recvmmsg call by default, and at most
+#define SC_DEFAULT_RECEIVE_BATCH 32
+#define SC_MAX_RECEIVE_BATCH 64
+/// tcp read sizes by default, and at most
+#define SC_DEFAULT_MIN_READ_CHUNK 4096
+#define SC_DEFAULT_MAX_READ_CHUNK 65536
+#define SC_MAX_READ_CHUNK 65536
+/// send queue size at which tcp sockets ask to hold back, and where they ask to continue, by default
+#define SC_DEFAULT_SEND_HIGH_WATERMARK (1 << 20)
+#define SC_DEFAULT_SEND_LOW_WATERMARK (1 << 18)
+/// most queued buffers sent with one sendmsg
+#define SC_MAX_SEND_IOV 64
+/// smallest payload sendZeroCopy hands to the kernel without copying. below, pinning the pages costs more than copying
+#define SC_MIN_ZEROCOPY_SIZE 16384
+/// most datagrams sent with one sendmmsg
+#define SC_MAX_SEND_BATCH 1024
+/// most datagrams the kernel splits one UDP_SEGMENT send into, and the largest udp payload (over IPv4) it may have
+#define SC_MAX_SEGMENTS 64
+#define SC_MAX_DATAGRAM_SIZE 65507
+/// most packets handed to one onPackets call. a socket that is flooded keeps reading and would never end its pass
+#define SC_MAX_PACKET_BATCH 256
 
 namespace sosimple {
 
+class SocketReactor;
+
 auto
 createTCPServer(socket_t acceptedSocket, Endpoint remote) -> std::shared_ptr<ComSocket>;
 
@@ -17,10 +57,14 @@ public:
     mutable socket_t mFD{POSIX_INVALID_DESCRIPTOR}; ///< if detected to be invalid/closed this is set back to -1 for shortcutting behaviour, otherwise constant
     mutable Endpoint mLocal{}; ///< might be lazy read after bind/construction once through getBoundEndpoint(), but doesn't change
     Endpoint mRemote{}; ///< remote empty for udp unicast or tcp listen. put during construction, then unchanged
-    mutable int mFlags; ///< only internal markers. not really affecting state, more so reflecting it
+    mutable std::atomic_int mFlags{0}; ///< only internal markers, set from the poll thread and user threads alike
 
     Watchdog mWatchDog{};
     Kind mKind;
+    SocketReactor* mReactor{nullptr}; ///< the poll thread this socket was assigned to in start()
+    uint32_t mSlot{0}; ///< where mReactor keeps this socket
+    TimerWheel<SocketBase>::Timer mTimer{}; ///< mWatchDog's deadline in the timer wheel of mReactor
+    std::shared_ptr<Strand> mStrand{std::make_shared<Strand>()}; ///< runs the callbacks of this socket in order on the worker
 
 private:
     Socket::SocketErrorCallback mSocketErrorEvent{};
@@ -114,6 +158,14 @@ public:
     auto
     accept() -> bool;
 
+    /// hand out a connection accepted by accept() or the io_uring reactor
+    auto
+    accepted(socket_t fd, Endpoint remote) -> void;
+
+    /// @param error errno of the failed accept
+    auto
+    acceptFailed(int error) -> void;
+
     auto
     checkWatchdog() -> void;
 
@@ -121,6 +173,163 @@ public:
 
 class ComSocketImpl : public SocketBase, public ComSocket {
     PacketReceivedCallback mPacketReceivedEvent;
+    BufferReceivedCallback mBufferReceivedEvent;
+    PacketsReceivedCallback mPacketsReceivedEvent;
+    std::atomic_bool mBatching{false}; ///< whether the poll thread collects packets for mPacketsReceivedEvent
+    std::vector<Packet> mBatch{}; ///< packets of the running poll pass, only touched by the poll thread
+    std::atomic_uint mReceiveBatch{SC_DEFAULT_RECEIVE_BATCH}; ///< datagrams per recvmmsg
+    std::atomic_uint64_t mTruncated{0}; ///< datagrams dropped because they didn't fit the receive buffer
+    std::atomic_size_t mMinChunk{SC_DEFAULT_MIN_READ_CHUNK}; ///< smallest tcp read
+    std::atomic_size_t mMaxChunk{SC_DEFAULT_MAX_READ_CHUNK}; ///< largest tcp read
+    size_t mChunk{SC_DEFAULT_MIN_READ_CHUNK}; ///< size of the next tcp read, only touched by the poll thread
+    size_t mReceiveBuffer{0}; ///< SO_RCVBUF raised for mChunk so far, only touched by the poll thread
+    std::unique_ptr<Framer> mFramer{}; ///< only touched by the poll thread
+    std::mutex mFramerMutex{};
+    std::unique_ptr<Framer> mNextFramer{}; ///< picked up by the poll thread with the next read, guarded by mFramerMutex
+    std::atomic_bool mFramerChanged{false};
+    BufferBlock* mAssembly{nullptr}; ///< start of a message spread over multiple reads, only ours while being filled
+    size_t mAssembled{0}; ///< bytes in mAssembly
+    size_t mAssemblyCapacity{0};
+    StreamCallback mStreamEvent{};
+    std::unique_ptr<StreamBuffer> mStream{}; ///< created once by onStream, before mStreaming is set
+    std::atomic_bool mStreaming{false};
+    std::atomic_bool mStreamNotified{false}; ///< a stream callback is queued, it sees whatever arrives until it runs
+    std::vector<uint8_t> mStreamBacklog{}; ///< received by io_uring before the switch to readiness, didn't fit the ring
+    /// bytes of a file in the send queue, owns a duplicate of the descriptor
+    struct FileRange {
+        int fd{-1};
+        uint64_t offset{0};
+        size_t size{0};
+
+        FileRange() = default;
+        FileRange(int file, uint64_t from, size_t length) : fd(file), offset(from), size(length) {}
+        FileRange(FileRange&& other) noexcept : fd(std::exchange(other.fd, -1)), offset(other.offset), size(other.size) {}
+        FileRange& operator=(FileRange&& other) noexcept;
+        ~FileRange();
+    };
+    /// a piece of the send queue
+    struct Outgoing {
+        Buffer owned{}; ///< copied into the queue
+        std::span<const uint8_t> borrowed{}; ///< or left with the caller of sendZeroCopy until sent is called
+        SentCallback sent{};
+        FileRange file{}; ///< or sent from a file by sendFile
+
+        auto
+        bytes() const -> std::span<const uint8_t>
+        { return borrowed.empty() ? owned.span() : borrowed; }
+
+        auto
+        size() const -> size_t
+        { return (file.fd >= 0) ? file.size : bytes().size(); }
+    };
+    /// a send with MSG_ZEROCOPY the kernel didn't report as done yet
+    struct ZeroCopySend {
+        uint32_t id; ///< the kernel counts the sends of a socket, completions come as ranges of those
+        bool done;
+        SentCallback sent; ///< set on the last send of a payload
+    };
+    mutable std::mutex mSendMutex{}; ///< keeps sends in order, guards the send queue
+    mutable std::deque<Outgoing> mSendQueue{}; ///< what the kernel didn't take yet
+    mutable size_t mSendOffset{0}; ///< bytes of the front buffer that went out already
+    mutable std::deque<ZeroCopySend> mZeroCopySends{}; ///< in order of their ids, guarded by mSendMutex
+    mutable uint32_t mZeroCopyNext{0}; ///< id of the next send with MSG_ZEROCOPY, guarded by mSendMutex
+    mutable bool mZeroCopy{false}; ///< SO_ZEROCOPY is set and the kernel doesn't copy anyways, guarded by mSendMutex
+    mutable bool mZeroCopyTried{false}; ///< guarded by mSendMutex
+    mutable std::atomic_size_t mQueued{0}; ///< bytes in mSendQueue, minus mSendOffset
+    mutable bool mAboveHigh{false}; ///< the queue went past the high watermark, guarded by mSendMutex
+    mutable size_t mSendBuffer{0}; ///< SO_SNDBUF raised for the send queue or batches so far, guarded by mSendMutex
+    std::atomic_size_t mHighWatermark{SC_DEFAULT_SEND_HIGH_WATERMARK};
+    std::atomic_size_t mLowWatermark{SC_DEFAULT_SEND_LOW_WATERMARK};
+    WritableCallback mWritableEvent{};
+    std::atomic<uint16_t> mSegmentSize{0}; ///< udp send() payloads are split into datagrams of this size
+    mutable std::atomic_bool mKernelSegments{false}; ///< UDP_SEGMENT is set to mSegmentSize and works
+
+    /// hand a packet to whichever callback is set
+    auto
+    deliver(const Buffer& payload, Endpoint remote) -> void;
+
+    /// collect or notify about a message
+    auto
+    emit(Buffer data, Endpoint from) -> void;
+
+    /// split read data into messages with mFramer
+    auto
+    unframe(Buffer data, Endpoint from) -> void;
+
+    /// append to mAssembly
+    auto
+    assemble(std::span<const uint8_t> bytes) -> void;
+
+    /// hand packets to the batch callback, or one by one if it was replaced in the meantime
+    auto
+    deliver(const std::vector<Packet>& packets) -> void;
+
+    /// copy into mStream as far as it has room, then stall it
+    /// @return bytes copied
+    auto
+    fillStream(const uint8_t* data, size_t size) -> size_t;
+
+    /// call the stream callback, if there's anything to look at
+    auto
+    deliverStream() -> void;
+
+    /// queue what a tcp send left over, or send it right away if nothing is queued
+    auto
+    sendStream(std::span<const std::span<const uint8_t>> parts) const -> void;
+
+    /// @param error errno of the failed send
+    auto
+    sendFailed(int error) const -> void;
+
+#if defined __linux__
+    /// send from a file with sendfile. call with mSendMutex held
+    /// @return bytes sent, -1 with the errno in error. a file that ends early is an error as well
+    auto
+    sendFileRange(int file, uint64_t offset, size_t size, int& error) const -> int64_t;
+#endif
+
+    /// set SO_ZEROCOPY on the first sendZeroCopy. call with mSendMutex held
+    /// @return whether sends may use MSG_ZEROCOPY
+    auto
+    enableZeroCopy() const -> bool;
+
+    /// send borrowed bytes, with MSG_ZEROCOPY if it's on, and remember the send until the kernel reports it done.
+    /// call with mSendMutex held
+    /// @param sent called once the kernel is done with bytes and everything borrowed before, if last is set
+    /// @return bytes sent, -1 with the errno in error
+    auto
+    sendBorrowed(std::span<const uint8_t> bytes, bool last, SentCallback& sent, int& error) const -> int64_t;
+
+    /// read the completions of zero copy sends from the error queue. call with mSendMutex held
+    /// @param finished receives the callbacks of the payloads the kernel is done with
+    auto
+    reapZeroCopy(std::vector<SentCallback>& finished) const -> void;
+
+    /// empty the send queue of a socket that's closing. call with mSendMutex held
+    /// @param finished receives the callbacks of the payloads the kernel is done with or never got. the others are
+    /// dropped, their completions can't be collected anymore
+    auto
+    abandonSends(std::vector<SentCallback>& finished) const -> void;
+
+    /// call sent callbacks on the strand
+    auto
+    notifySent(std::vector<SentCallback> finished) const -> void;
+
+    /// call sent for bytes that were copied, but never before the send that copied them returned. unless the socket
+    /// is closed or not polled and there's no worker, then right away
+    auto
+    sentLater(SentCallback sent) const -> void;
+
+    /// send payload as datagrams of mSegmentSize
+    auto
+    sendSegments(std::span<const uint8_t> payload, const sockaddr_storage& addr, const Endpoint& remote) const -> void;
+
+    /// raise SO_SNDBUF to size, unless it was raised that far already
+    auto
+    growSendBuffer(size_t size) const -> void;
+
+    auto
+    notifyWritable() -> void;
 
 public:
     ComSocketImpl() = default;
@@ -162,14 +371,66 @@ public:
 // ----- for io -----
 
     auto
-    notifyPacket(const std::vector<uint8_t>& payload, Endpoint remote) -> void;
+    notifyPacket(Buffer payload, Endpoint remote) -> void;
 
     auto
     onPacket(PacketReceivedCallback callback) -> void override;
 
+    auto
+    onPacketBuffer(BufferReceivedCallback callback) -> void override;
+
+    auto
+    notifyPackets(std::vector<Packet> packets) -> void;
+
+    auto
+    onPackets(PacketsReceivedCallback callback) -> void override;
+
+    /// queue the stream callback, unless it's queued already
+    auto
+    notifyStream() -> void;
+
+    auto
+    onStream(StreamCallback callback, size_t capacity) -> void override;
+
+    auto
+    setReceiveBatch(unsigned count) -> void override;
+
+    auto
+    setFramer(std::unique_ptr<Framer> framer) -> void override;
+
+    auto
+    setReadChunkSize(size_t minimum, size_t maximum) -> void override;
+
+    auto
+    getTruncatedCount() const -> uint64_t override;
+
     auto
     send(const std::vector<uint8_t>& payload, Endpoint remote) const -> void override;
 
+    auto
+    send(std::span<const std::span<const uint8_t>> parts, Endpoint remote) const -> void override;
+
+    auto
+    sendBatch(std::span<const Datagram> datagrams) const -> size_t override;
+
+    auto
+    sendZeroCopy(std::span<const uint8_t> payload, SentCallback sent, Endpoint remote) const -> void override;
+
+    auto
+    sendFile(int file, uint64_t offset, size_t length) const -> void override;
+
+    auto
+    setSegmentSize(uint16_t size) -> void override;
+
+    auto
+    getSendQueueSize() const -> size_t override;
+
+    auto
+    setSendWatermarks(size_t high, size_t low) -> void override;
+
+    auto
+    onWritable(WritableCallback callback) -> void override;
+
 // ----- for polling -----
 
     /// read one packet of how-ever-many-available-bytes
@@ -177,6 +438,49 @@ public:
     auto
     read() -> bool;
 
+    /// send what's in the send queue, once the socket is writable, and collect finished zero copy sends
+    /// @return true if the queue is empty and no zero copy send is outstanding, false if there's more to wait for
+    auto
+    flush() -> bool;
+
+    /// read into mStream until it's full or the socket is drained
+    auto
+    readStream() -> bool;
+
+#if defined __linux__
+    /// read datagrams with recvmmsg, mReceiveBatch at a time. large datagrams spill over into a large block
+    auto
+    readBatch() -> bool;
+
+    /// read merged datagrams with recvmsg and split them at the segment size the kernel reports
+    auto
+    readCoalesced() -> bool;
+#endif
+
+    /// hand out data read by read()
+    auto
+    received(Buffer data, Endpoint from) -> void;
+
+    /// hand out data received into some other memory, like the buffers of the io_uring reactor
+    auto
+    received(const uint8_t* data, size_t size, Endpoint from) -> void;
+
+    /// grow or shrink mChunk after a tcp read of size bytes
+    auto
+    adaptChunk(size_t size) -> void;
+
+    /// hand out the packets collected for the batch callback, at the end of a poll pass
+    auto
+    flushReceived() -> void;
+
+    /// count a datagram that was dropped, because it didn't fit the buffer it was received into
+    auto
+    truncated() -> void;
+
+    /// @param error errno of the failed read, 0 if the remote closed the stream
+    auto
+    readFailed(int error) -> void;
+
     auto
     checkWatchdog() -> void;
 };
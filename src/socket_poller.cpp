@@ -1,19 +1,136 @@
 #include "socket_poller.hpp"
+#include "platforms_internal.hpp"
+
+#if defined __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
+/// how many readiness events or completions are collected per poll pass
+#define SC_POLLER_MAX_EVENTS 256
+
+/// io_uring sizing: submission queue entries, provided receive buffers per reactor and how much data goes in one buffer.
+/// datagram buffers also hold the recvmsg header and source address in front of the payload
+#define SC_URING_ENTRIES 1024
+#define SC_URING_BUFFERS 512
+#define SC_URING_CHUNK_SIZE 4096
+#define SC_URING_BUFFER_SIZE (SC_URING_CHUNK_SIZE + sizeof(io_uring_recvmsg_out) + sizeof(sockaddr_storage))
+
+#if defined __linux__
+/// what an epoll registration or io_uring request is for, top byte of the tag
+enum class RequestKind : uint8_t {
+    Wakeup = 1,
+    Readiness, ///< epoll registration of a socket, or io_uring poll of a coalescing udp socket
+    Receive,
+    ReceiveMessage,
+    Accept,
+    Cancel,
+    Writable, ///< io_uring poll of a socket with a send queue
+};
+
+/// epoll data and io_uring user_data: kind, registration generation (24 bit) and slot.
+/// events are resolved through the slots with this, so a late event never reaches the next tenant of a slot
+static auto
+makeTag(RequestKind kind, uint32_t index, uint32_t generation) -> uint64_t
+{ return (static_cast<uint64_t>(kind) << 56) | (static_cast<uint64_t>(generation & 0xFFFFFF) << 32) | index; }
+
+static auto
+tagKind(uint64_t tag) -> RequestKind
+{ return static_cast<RequestKind>(tag >> 56); }
+
+static auto
+tagGeneration(uint64_t tag) -> uint32_t
+{ return static_cast<uint32_t>(tag >> 32) & 0xFFFFFF; }
+
+static auto
+tagSlot(uint64_t tag) -> uint32_t
+{ return static_cast<uint32_t>(tag); }
+#endif
+
+sosimple::SocketReactor::SocketReactor(IOBackend backend)
+{
+#if defined __linux__
+    wakeFD = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    int error = POSIX_ERRNO;
+    if (!POSIX_ISVALIDDESCRIPTOR(wakeFD))
+        throw socket_error(SocketError::HandleLimit, std::string("Unable to create socket reactor: ") + GNU_STRERRORDESC_NP(error));
+
+    if (backend == IOBackend::IOUring && IOUring::isSupported()) {
+        try {
+            uring = std::make_unique<IOUring>(SC_URING_ENTRIES, SC_URING_BUFFERS, SC_URING_BUFFER_SIZE);
+        } catch (socket_error&) {
+            // kernel says no (too old, disabled, locked memory limit), epoll it is
+        }
+    }
+    if (uring) {
+        recvTemplate.msg_namelen = sizeof(sockaddr_storage);
+        armWakeup();
+        uring->submit();
+        return;
+    }
+
+    epollFD = ::epoll_create1(EPOLL_CLOEXEC);
+    error = POSIX_ERRNO;
+    if (!POSIX_ISVALIDDESCRIPTOR(epollFD)) {
+        POSIX_CLOSE(wakeFD);
+        throw socket_error(SocketError::HandleLimit, std::string("Unable to create socket reactor: ") + GNU_STRERRORDESC_NP(error));
+    }
+    // level triggered, it stays ready until the poll thread drained it
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = makeTag(RequestKind::Wakeup, 0, 0);
+    ::epoll_ctl(epollFD, EPOLL_CTL_ADD, wakeFD, &event);
+#endif
+}
+
+sosimple::SocketReactor::~SocketReactor()
+{
+    if (pollThread.joinable()) {
+        isPolling = false;
+        wakeup();
+        pollThread.join();
+    }
+#if defined __linux__
+    uring.reset();
+    if (POSIX_ISVALIDDESCRIPTOR(wakeFD)) POSIX_CLOSE(wakeFD);
+    if (POSIX_ISVALIDDESCRIPTOR(epollFD)) POSIX_CLOSE(epollFD);
+#endif
+    for (auto& page : pages) delete[] page.load();
+}
 
 auto
-sosimple::SocketPoller::get() -> SocketPoller& {
-    static SocketPoller instance{};
-    return instance;
+sosimple::SocketReactor::slot(uint32_t index) const -> Registration*
+{
+    Registration* page = pages[index / SLOTS_PER_PAGE].load(std::memory_order_acquire);
+    return page ? &page[index % SLOTS_PER_PAGE] : nullptr;
 }
 
 auto
-sosimple::SocketPoller::operator+=(std::shared_ptr<sosimple::Socket> const& socket) -> void
+sosimple::SocketReactor::resolve(uint32_t index, uint32_t generation) const -> sosimple::SocketBase*
+{
+    if (index >= slotCount.load(std::memory_order_acquire)) return nullptr;
+    Registration* registration = slot(index);
+    if (!registration) return nullptr;
+    // socket first: a new tenant publishes its generation before the socket, so if we see the new socket,
+    // we also see the new generation and reject it
+    sosimple::SocketBase* socket = registration->socket.load();
+    if ((registration->generation.load() & 0xFFFFFF) != generation) return nullptr;
+    return socket;
+}
+
+auto
+sosimple::SocketReactor::operator+=(std::shared_ptr<sosimple::SocketBase> const& socket) -> void
 {
     std::unique_lock lock{socket_mutex};
-    // thread management
+    // thread management. once started the thread stays around until the poller is destroyed, it costs nothing
+    // while blocked and sockets die from all kinds of threads, including the poll thread itself, which can't join itself
     if (!isPolling) {
         isPolling = true;
         pollThread = std::thread{[self=this]{
+#if defined __linux__
+            // operator() blocks in the kernel until a socket is ready, a watchdog is due or we get woken up
+            while (self->isPolling) (*self)();
+#else
             int delayms = 0;
             while (self->isPolling) {
                 if ((*self)()) {
@@ -26,50 +143,577 @@ sosimple::SocketPoller::operator+=(std::shared_ptr<sosimple::Socket> const& sock
                     std::this_thread::sleep_for(std::chrono::milliseconds(delayms));
                 }
             }
+#endif
         }};
     }
 
     // state
-    sockets.emplace(socket->getNativeSocket(), std::weak_ptr<sosimple::Socket>{socket});
+    uint32_t index;
+    if (!freeSlots.empty()) {
+        index = freeSlots.back();
+        freeSlots.pop_back();
+    } else {
+        index = slotCount;
+        if (index / SLOTS_PER_PAGE >= MAX_PAGES) {
+            // the socket's destructor must not unregister a slot it never got
+            socket->mReactor = nullptr;
+            throw socket_error(SocketError::HandleLimit, "Unable to register socket with poller: Too many sockets");
+        }
+        if (!pages[index / SLOTS_PER_PAGE]) pages[index / SLOTS_PER_PAGE].store(new Registration[SLOTS_PER_PAGE]);
+        slotCount.store(index + 1);
+    }
+    Registration& registration = *slot(index);
+    registration.released = false;
+    registration.writeRequest = 0;
+    registration.generation.store(nextGeneration++);
+    registration.socket.store(socket.get());
+    socket->mSlot = index;
+    load++;
+    schedule(*socket);
+#if defined __linux__
+    if (uring) {
+        // the multishot request stays armed until it fails or gets cancelled
+        arm(*socket, index);
+        uring->submit();
+        return;
+    }
+    // edge triggered: we get one event per state change, read() and accept() drain until EAGAIN anyways.
+    // if data is already pending, adding the descriptor queues an event right away. only tcp sockets have a send
+    // queue to flush. udp would report writability along with every read, and flush for nothing
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+    if (socket->mKind == Socket::Kind::TCP_Client || socket->mKind == Socket::Kind::TCP_Server) event.events |= EPOLLOUT;
+    event.data.u64 = makeTag(RequestKind::Readiness, index, registration.generation);
+    if (::epoll_ctl(epollFD, EPOLL_CTL_ADD, socket->mFD, &event) == -1) {
+        int error = POSIX_ERRNO;
+        // undo all of the above here, the socket's destructor must not unregister it a second time
+        registration.socket.store(nullptr);
+        freeSlots.push_back(index);
+        load--;
+        {
+            std::unique_lock timerLock{timer_mutex};
+            timers.cancel(socket->mTimer);
+        }
+        socket->mReactor = nullptr;
+        throw socket_error(SocketError::Generic, std::string("Unable to register socket with poller: ") + GNU_STRERRORDESC_NP(error));
+    }
+#endif
+}
+
+auto
+sosimple::SocketReactor::operator-=(sosimple::SocketBase& socket) -> void
+{
+    bool onPollThread;
+    {
+        std::unique_lock lock{socket_mutex};
+        Registration& registration = *slot(socket.mSlot);
+        registration.socket.store(nullptr);
+        freeSlots.push_back(socket.mSlot);
+        load--;
+        {
+            std::unique_lock timerLock{timer_mutex};
+            timers.cancel(socket.mTimer);
+        }
+#if defined __linux__
+        // a released descriptor is closed already and might belong to someone else by now
+        if (!registration.released) {
+            if (uring) {
+                cancel(registration.request);
+                if (registration.writeRequest) cancel(registration.writeRequest);
+            } else ::epoll_ctl(epollFD, EPOLL_CTL_DEL, socket.mFD, nullptr);
+        }
+#endif
+        onPollThread = pollThread.get_id() == std::this_thread::get_id();
+    }
+    // this is called from socket destructors. the poll thread might have picked up the pointer just before we cleared it,
+    // wait for it to finish that pass. on the poll thread itself it is between sockets already
+    if (onPollThread) return;
+    uint64_t seen = epoch.load();
+    if (seen & 1) {
+        while (epoch.load() == seen) std::this_thread::yield();
+    }
 }
 
 auto
-sosimple::SocketPoller::operator-=(socket_t descriptor) -> void
+sosimple::SocketReactor::release(sosimple::SocketBase const& socket) -> void
 {
     std::unique_lock lock{socket_mutex};
+    Registration& registration = *slot(socket.mSlot);
+    if (registration.released) return;
+    registration.released = true;
+    // closed sockets get no more events and need no more watchdog checks
+    registration.socket.store(nullptr);
+    {
+        std::unique_lock timerLock{timer_mutex};
+        timers.cancel(const_cast<SocketBase&>(socket).mTimer);
+    }
+#if defined __linux__
+    // io_uring holds its own reference to the socket while requests are armed, it would never really close.
+    // epoll drops closed descriptors on its own
+    if (uring) {
+        cancel(registration.request);
+        if (registration.writeRequest) cancel(registration.writeRequest);
+    }
+#endif
+}
 
-    // state
-    auto where = sockets.find(descriptor);
-    if (where != sockets.end()) sockets.erase(where);
+auto
+sosimple::SocketReactor::resume(sosimple::SocketBase& socket) -> void
+{
+    {
+        std::unique_lock lock{resume_mutex};
+        resumed.push_back(socket.weak_from_this());
+    }
+    wakeup();
+}
 
-    // thread management
-    if (sockets.empty() && isPolling) {
-        isPolling = false;
-        pollThread.join();
+auto
+sosimple::SocketReactor::awaitWritable(sosimple::SocketBase const& socket) -> void
+{
+#if defined __linux__
+    if (!uring) return;
+    {
+        std::unique_lock lock{resume_mutex};
+        writers.push_back(const_cast<SocketBase&>(socket).weak_from_this());
     }
+    wakeup();
+#endif
 }
 
 auto
-sosimple::SocketPoller::operator()() -> bool
+sosimple::SocketReactor::schedule(sosimple::SocketBase& socket) -> void
 {
-    std::unique_lock lock{socket_mutex};
-    decltype(sockets) copy{sockets};
-    lock.unlock(); // we got our copy, we dont care anymore
+    std::unique_lock lock{timer_mutex};
+    auto deadline = socket.mWatchDog.deadline();
+    if (!deadline) {
+        timers.cancel(socket.mTimer);
+        return;
+    }
+    socket.mTimer.owner = &socket;
+    timers.schedule(socket.mTimer, *deadline);
+    // the poll thread might be sleeping past this. on the poll thread itself, wakeAt is always in the past
+    if (*deadline < wakeAt) {
+        wakeAt = *deadline;
+        wakeup();
+    }
+}
+
+auto
+sosimple::SocketReactor::expire() -> std::optional<std::chrono::steady_clock::time_point>
+{
+    {
+        std::unique_lock lock{timer_mutex};
+        timers.advance(now, expired);
+        for (auto* sock : expired) {
+            // scheduled timers keep their socket from leaving operator-=, so it's still alive here
+            auto deadline = sock->mWatchDog.deadline();
+            if (!deadline) continue;
+            if (*deadline > now) timers.schedule(sock->mTimer, *deadline); // reset since it was scheduled
+            else if (auto strong = sock->weak_from_this().lock()) pending.push_back(std::move(strong));
+        }
+        expired.clear();
+    }
+    // timeout callbacks run without the lock, they change timeouts themselves
+    for (auto& sock : pending) {
+        watch(sock);
+        schedule(*sock);
+    }
+    pending.clear();
+
+    std::unique_lock lock{timer_mutex};
+    auto next = timers.next();
+    wakeAt = next.value_or(std::chrono::steady_clock::time_point::max());
+    return next;
+}
+
+auto
+sosimple::SocketReactor::wakeup() -> void
+{
+#if defined __linux__
+    uint64_t one{1};
+    // can only fail if the counter is about to overflow, in which case it's readable anyways
+    [[maybe_unused]] auto _ = ::write(wakeFD, &one, sizeof(one));
+#endif
+}
+
+#if defined __linux__
+auto
+sosimple::SocketReactor::arm(SocketBase& socket, uint32_t index) -> void
+{
+    Registration& registration = *slot(index);
+    socket_t fd = socket.mFD;
+    uint32_t generation = registration.generation;
+    if (socket.mKind == Socket::Kind::TCP_Listen) {
+        uring->queue([&](io_uring_sqe& sqe){
+            sqe.opcode = IORING_OP_ACCEPT;
+            sqe.fd = fd;
+            sqe.ioprio = IORING_ACCEPT_MULTISHOT;
+            sqe.accept_flags = SOCK_NONBLOCK;
+            sqe.user_data = registration.request = makeTag(RequestKind::Accept, index, generation);
+        });
+    } else if ((socket.mFlags & (SC_SOCKFLAG_COALESCED | SC_SOCKFLAG_LARGE_DATAGRAMS | SC_SOCKFLAG_STREAM)) != 0) {
+        // merged or large datagrams don't fit the provided buffers and streams receive into their own ring,
+        // wait for readiness and read them like epoll does
+        uring->queue([&](io_uring_sqe& sqe){
+            sqe.opcode = IORING_OP_POLL_ADD;
+            sqe.fd = fd;
+            sqe.poll32_events = POLLIN;
+            sqe.len = IORING_POLL_ADD_MULTI;
+            sqe.user_data = registration.request = makeTag(RequestKind::Readiness, index, generation);
+        });
+    } else if (socket.mKind == Socket::Kind::TCP_Client || socket.mKind == Socket::Kind::TCP_Server) {
+        uring->queue([&](io_uring_sqe& sqe){
+            sqe.opcode = IORING_OP_RECV;
+            sqe.fd = fd;
+            sqe.len = SC_URING_CHUNK_SIZE;
+            sqe.ioprio = IORING_RECV_MULTISHOT;
+            sqe.flags = IOSQE_BUFFER_SELECT;
+            sqe.buf_group = IOUring::BUFFER_GROUP;
+            sqe.user_data = registration.request = makeTag(RequestKind::Receive, index, generation);
+        });
+    } else {
+        // datagrams need the source address, that only comes with recvmsg
+        uring->queue([&](io_uring_sqe& sqe){
+            sqe.opcode = IORING_OP_RECVMSG;
+            sqe.fd = fd;
+            sqe.addr = reinterpret_cast<uint64_t>(&recvTemplate);
+            sqe.len = 1;
+            sqe.ioprio = IORING_RECV_MULTISHOT;
+            sqe.flags = IOSQE_BUFFER_SELECT;
+            sqe.buf_group = IOUring::BUFFER_GROUP;
+            sqe.user_data = registration.request = makeTag(RequestKind::ReceiveMessage, index, generation);
+        });
+    }
+}
+
+auto
+sosimple::SocketReactor::armWritable(SocketBase& socket, uint32_t index) -> void
+{
+    Registration& registration = *slot(index);
+    socket_t fd = socket.mFD;
+    uint32_t generation = registration.generation;
+    // with only zero copy completions left, writability would complete the poll over and over. errors always do.
+    // data queued meanwhile waits for the next completion
+    auto* comsock = dynamic_cast<sosimple::ComSocketImpl*>(&socket);
+    short events = (comsock && comsock->getSendQueueSize() == 0) ? POLLERR : POLLOUT;
+    uring->queue([&](io_uring_sqe& sqe){
+        sqe.opcode = IORING_OP_POLL_ADD;
+        sqe.fd = fd;
+        sqe.poll32_events = events;
+        sqe.user_data = registration.writeRequest = makeTag(RequestKind::Writable, index, generation);
+    });
+}
+
+auto
+sosimple::SocketReactor::armWakeup() -> void
+{
+    uring->queue([&](io_uring_sqe& sqe){
+        sqe.opcode = IORING_OP_POLL_ADD;
+        sqe.fd = wakeFD;
+        sqe.poll32_events = POLLIN;
+        sqe.len = IORING_POLL_ADD_MULTI;
+        sqe.user_data = makeTag(RequestKind::Wakeup, 0, 0);
+    });
+}
+
+auto
+sosimple::SocketReactor::cancel(uint64_t request) -> void
+{
+    // by user_data rather than by descriptor: the kernel finds those in a hash table instead of walking every request
+    uring->queue([&](io_uring_sqe& sqe){
+        sqe.opcode = IORING_OP_ASYNC_CANCEL;
+        sqe.fd = -1;
+        sqe.addr = request;
+        sqe.user_data = makeTag(RequestKind::Cancel, tagSlot(request), 0);
+    });
+    // has to reach the kernel while the descriptor is still open
+    uring->submit();
+}
+
+auto
+sosimple::SocketReactor::complete() -> bool
+{
+    uring->wait(waitMS);
+    now = std::chrono::steady_clock::now();
+    io_uring_cqe completions[SC_POLLER_MAX_EVENTS];
+    unsigned count = uring->reap(completions, SC_POLLER_MAX_EVENTS);
+
+    std::shared_ptr<sosimple::SocketBase> active[SC_POLLER_MAX_EVENTS];
+    epoch++;
+    for (unsigned i{0}; i < count; i++) {
+        auto kind = tagKind(completions[i].user_data);
+        if (kind == RequestKind::Wakeup || kind == RequestKind::Cancel) continue;
+        auto* socket = resolve(tagSlot(completions[i].user_data), tagGeneration(completions[i].user_data));
+        if (socket) active[i] = socket->weak_from_this().lock();
+    }
+    epoch++;
 
-    // read all sockets that have data
     bool areWeBusy{false};
-    for (auto [_,wsock] : copy) {
-        // no error and no data, skip read
-        auto sock = wsock.lock();
-        if (!sock) { continue; }
+    bool rearm[SC_POLLER_MAX_EVENTS]{};
+    bool rearmWritable[SC_POLLER_MAX_EVENTS]{};
+    bool rearmWakeup{false};
+    for (unsigned i{0}; i < count; i++) {
+        const io_uring_cqe& cqe = completions[i];
+        auto kind = tagKind(cqe.user_data);
+        bool more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+        bool hasBuffer = (cqe.flags & IORING_CQE_F_BUFFER) != 0;
+        auto bufferId = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+        uint8_t* buffer = hasBuffer ? uring->buffer(bufferId) : nullptr;
+
+        if (kind == RequestKind::Wakeup) {
+            uint64_t value;
+            [[maybe_unused]] auto _ = ::read(wakeFD, &value, sizeof(value));
+            if (!more) rearmWakeup = true;
+        } else if (!active[i] && kind == RequestKind::Accept) {
+            // the listen socket went away while the cancel was on its way, nobody takes this connection
+            if (cqe.res >= 0) POSIX_CLOSE(cqe.res);
+        } else if (active[i] && kind == RequestKind::Accept) {
+            auto listsock = std::dynamic_pointer_cast<sosimple::ListenSocketImpl>(active[i]);
+            if (cqe.res >= 0) {
+                // multishot accept can't hand out addresses, ask the new socket instead
+                sockaddr_storage addr{};
+                socklen_t addrSz = sizeof(addr);
+                if (::getpeername(cqe.res, (sockaddr*)&addr, &addrSz) == 0) {
+                    listsock->accepted(cqe.res, Endpoint{(sockaddr*)&addr, addrSz});
+                    areWeBusy = true;
+                } else {
+                    POSIX_CLOSE(cqe.res); // gone before we even saw it
+                }
+            } else {
+                listsock->acceptFailed(-cqe.res);
+            }
+        } else if (active[i] && kind == RequestKind::Readiness) {
+            if (cqe.res > 0 && dispatch(active[i])) areWeBusy = true;
+        } else if (active[i] && kind == RequestKind::Writable) {
+            // a single shot, it's polled again as long as the queue doesn't drain
+            if (cqe.res > 0 && !flush(active[i])) rearmWritable[i] = true;
+            continue;
+        } else if (active[i]) {
+            auto comsock = std::dynamic_pointer_cast<sosimple::ComSocketImpl>(active[i]);
+            if (cqe.res > 0 && buffer && kind == RequestKind::ReceiveMessage) {
+                auto* header = reinterpret_cast<io_uring_recvmsg_out*>(buffer);
+                uint8_t* name = buffer + sizeof(io_uring_recvmsg_out);
+                uint8_t* payload = name + recvTemplate.msg_namelen + recvTemplate.msg_controllen;
+                // on truncation payloadlen is the size of the datagram, not what fit into the buffer
+                size_t size = std::min<size_t>(header->payloadlen, cqe.res - (payload - buffer));
+                if ((header->flags & MSG_TRUNC) != 0) {
+                    comsock->truncated();
+                    if ((comsock->mFlags & SC_SOCKFLAG_LARGE_DATAGRAMS) == 0) {
+                        // the multishot ends with the cancel and is re-armed as readiness poll below
+                        comsock->mFlags |= SC_SOCKFLAG_LARGE_DATAGRAMS;
+                        if (more) cancel(cqe.user_data);
+                    }
+                } else if (size > 0) {
+                    comsock->received(payload, size, Endpoint{(sockaddr*)name, std::min<socklen_t>(header->namelen, recvTemplate.msg_namelen)});
+                    areWeBusy = true;
+                }
+            } else if (cqe.res > 0 && buffer) {
+                bool streaming = (comsock->mFlags & SC_SOCKFLAG_STREAM) != 0;
+                comsock->received(buffer, cqe.res, comsock->mRemote);
+                // the multishot ends with the cancel and is re-armed as readiness poll below
+                if (!streaming && more && (comsock->mFlags & SC_SOCKFLAG_STREAM) != 0) cancel(cqe.user_data);
+                areWeBusy = true;
+            } else if (cqe.res == 0 && kind == RequestKind::Receive) {
+                comsock->readFailed(0); // end of stream
+            } else if (cqe.res < 0 && cqe.res != -ENOBUFS && cqe.res != -ECANCELED && cqe.res != -EAGAIN) {
+                // running out of provided buffers only ends the multishot, we'll re-arm below
+                comsock->readFailed(-cqe.res);
+            }
+        }
+
+        if (hasBuffer) uring->recycle(bufferId);
+        if (!more && active[i] && (active[i]->mFlags & SC_SOCKFLAG_CLOSED) == 0) rearm[i] = true;
+    }
+
+    // sockets hand out what they got in this pass all at once
+    for (unsigned i{0}; i < count; i++) {
+        if (auto comsock = std::dynamic_pointer_cast<sosimple::ComSocketImpl>(active[i])) comsock->flushReceived();
+    }
+
+    if (rearmWakeup) armWakeup();
+    {
+        std::unique_lock lock{socket_mutex};
+        for (unsigned i{0}; i < count; i++) {
+            if (!rearm[i] && !rearmWritable[i]) continue;
+            // the socket might have been released while we were busy delivering
+            uint32_t index = tagSlot(completions[i].user_data);
+            if (resolve(index, tagGeneration(completions[i].user_data)) != active[i].get()) continue;
+            if (rearm[i]) arm(*active[i], index);
+            else armWritable(*active[i], index);
+        }
+    }
+    // submitted with the next wait
+    return areWeBusy;
+}
+#endif
+
+auto
+sosimple::SocketReactor::dispatch(std::shared_ptr<sosimple::SocketBase> const& sock) -> bool
+{
+    if (auto comsock = std::dynamic_pointer_cast<sosimple::ComSocketImpl>(sock)) {
+        bool readSomething = comsock->read();
+        comsock->flushReceived();
+        return readSomething;
+    } else if (auto listsock = std::dynamic_pointer_cast<sosimple::ListenSocketImpl>(sock)) {
+        return listsock->accept();
+    }
+    return false;
+}
+
+auto
+sosimple::SocketReactor::resumeAll() -> bool
+{
+    {
+        std::unique_lock lock{resume_mutex};
+        if (resumed.empty() && writers.empty()) return false;
+        resuming.swap(resumed);
+        writing.swap(writers);
+    }
+#if defined __linux__
+    if (!writing.empty()) {
+        std::unique_lock lock{socket_mutex};
+        for (auto& weak : writing) {
+            auto sock = weak.lock();
+            // gone from this reactor or released in the meantime, nothing to wait for anymore
+            if (sock && slot(sock->mSlot)->socket.load() == sock.get()) armWritable(*sock, sock->mSlot);
+        }
+        writing.clear();
+    }
+#endif
+    bool readSomething{false};
+    for (auto& weak : resuming) {
+        auto sock = weak.lock();
+        if (!sock) continue;
+        if ((sock->mFlags & SC_SOCKFLAG_CLOSED) == 0 && dispatch(sock)) readSomething = true;
+        // and hand out what the send queue finished in the meantime
+        flush(sock);
+    }
+    resuming.clear();
+    return readSomething;
+}
+
+auto
+sosimple::SocketReactor::flush(std::shared_ptr<sosimple::SocketBase> const& sock) -> bool
+{
+    if (auto comsock = std::dynamic_pointer_cast<sosimple::ComSocketImpl>(sock)) return comsock->flush();
+    return true;
+}
 
-        if (auto comsock = std::dynamic_pointer_cast<sosimple::ComSocketImpl>(sock)) {
-            if (comsock->read()) areWeBusy = true;
-            else comsock->checkWatchdog();
-        } else if (auto listsock = std::dynamic_pointer_cast<sosimple::ListenSocketImpl>(sock)) {
-            if (listsock->accept()) areWeBusy = true;
-            else listsock->checkWatchdog();
+auto
+sosimple::SocketReactor::watch(std::shared_ptr<sosimple::SocketBase> const& sock) -> void
+{
+    if (auto comsock = std::dynamic_pointer_cast<sosimple::ComSocketImpl>(sock)) {
+        comsock->checkWatchdog();
+    } else if (auto listsock = std::dynamic_pointer_cast<sosimple::ListenSocketImpl>(sock)) {
+        listsock->checkWatchdog();
+    }
+}
+
+auto
+sosimple::SocketReactor::operator()() -> bool
+{
+    bool areWeBusy{false};
+
+#if defined __linux__
+    // read all sockets that have data
+    epoll_event events[SC_POLLER_MAX_EVENTS];
+    int ready = uring ? 0 : ::epoll_wait(epollFD, events, SC_POLLER_MAX_EVENTS, waitMS);
+    if (!uring) now = std::chrono::steady_clock::now();
+    if (uring) {
+        areWeBusy = complete();
+    } else if (ready > 0) {
+        std::shared_ptr<sosimple::SocketBase> active[SC_POLLER_MAX_EVENTS];
+        epoch++;
+        for (int i{0}; i < ready; i++) {
+            if (tagKind(events[i].data.u64) == RequestKind::Wakeup) {
+                uint64_t count;
+                [[maybe_unused]] auto _ = ::read(wakeFD, &count, sizeof(count));
+                continue;
+            }
+            auto* socket = resolve(tagSlot(events[i].data.u64), tagGeneration(events[i].data.u64));
+            // callbacks might drop the last reference while we're reading, hold one for the duration
+            if (socket) active[i] = socket->weak_from_this().lock();
         }
+        epoch++;
+        for (int i{0}; i < ready; i++) {
+            if (!active[i]) continue;
+            // the error queue has zero copy completions as well
+            if ((events[i].events & (EPOLLOUT | EPOLLERR)) != 0) flush(active[i]);
+            if ((events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) != 0 && dispatch(active[i])) areWeBusy = true;
+        }
+    }
+
+    if (resumeAll()) areWeBusy = true;
+
+    // the earliest watchdog to trip decides how long we may sleep
+    auto wakeAt = expire();
+    if (wakeAt) {
+        auto remaining = std::chrono::ceil<std::chrono::milliseconds>(*wakeAt - std::chrono::steady_clock::now());
+        waitMS = static_cast<int>(std::max<int64_t>(remaining.count(), 0));
+    } else {
+        waitMS = -1;
+    }
+#else
+    // no readiness api, try to read every socket
+    now = std::chrono::steady_clock::now();
+    epoch++;
+    uint32_t slots = slotCount.load(std::memory_order_acquire);
+    for (uint32_t index{0}; index < slots; index++) {
+        auto* sock = slot(index)->socket.load(std::memory_order_acquire);
+        if (!sock) { continue; }
+        if (auto strong = sock->weak_from_this().lock()) pending.push_back(std::move(strong));
     }
+    epoch++;
+    for (auto& sock : pending) {
+        if (dispatch(sock)) areWeBusy = true;
+        flush(sock);
+    }
+    pending.clear();
+    if (resumeAll()) areWeBusy = true;
+    expire();
+#endif
     return areWeBusy;
-}
\ No newline at end of file
+}
+
+auto
+sosimple::SocketPoller::get() -> SocketPoller& {
+    static SocketPoller instance{};
+    return instance;
+}
+
+auto
+sosimple::SocketPoller::operator+=(std::shared_ptr<sosimple::SocketBase> const& socket) -> void
+{
+    SocketReactor* target{nullptr};
+    {
+        std::unique_lock lock{reactor_mutex};
+        while (reactors.size() < reactorCount) reactors.emplace_back(std::make_unique<SocketReactor>(backend));
+        // the load is only a hint, it can change while we look. that's fine, it'll even out
+        for (size_t i{0}; i < reactorCount; i++) {
+            if (!target || reactors[i]->getLoad() < target->getLoad()) target = reactors[i].get();
+        }
+    }
+    socket->mReactor = target;
+    *target += socket;
+}
+
+auto
+sosimple::SocketPoller::operator-=(sosimple::SocketBase& socket) -> void
+{
+    // reactors live as long as the poller, no need to lock anything here
+    if (socket.mReactor) *socket.mReactor -= socket;
+}
+
+auto
+sosimple::SocketPoller::setThreadCount(size_t count) -> void
+{
+    std::unique_lock lock{reactor_mutex};
+    reactorCount = std::max<size_t>(count, 1);
+}
+
+auto
+sosimple::SocketPoller::setBackend(IOBackend newBackend) -> void
+{
+    std::unique_lock lock{reactor_mutex};
+    backend = newBackend;
+}
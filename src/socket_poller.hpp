@@ -1,33 +1,206 @@
-#include <map>
+#include <array>
 #include <mutex>
 #include <memory>
+#include <atomic>
+#include <vector>
 
 #include <sosimple/utilities.hpp>
 #include "socket_impl.hpp"
+#include "io_uring.hpp"
 
 namespace sosimple {
 
-class SocketPoller {
-    std::map<socket_t, std::weak_ptr<sosimple::Socket>> sockets{};
+/// one poll thread with its own shard of sockets
+class SocketReactor {
+    /**
+     * Sockets sit in slots that never move, so the poll thread can walk and look them up without the lock and
+     * without touching reference counts. Registering and removing still happens under socket_mutex.
+     * Slots are reused, the generation tells events and completions for a previous tenant apart.
+     */
+    struct Registration {
+        std::atomic<sosimple::SocketBase*> socket{nullptr}; ///< cleared on removal or release, read by the poll thread
+        std::atomic<uint32_t> generation{0}; ///< bumped for every new tenant, before socket is set
+        bool released{false}; ///< the socket closed its descriptor already, nothing to unregister anymore
+        uint64_t request{0}; ///< user_data of the armed multishot request, io_uring only
+        uint64_t writeRequest{0}; ///< user_data of the last poll for writability, io_uring only
+    };
+    static constexpr uint32_t SLOTS_PER_PAGE = 1024;
+    static constexpr uint32_t MAX_PAGES = 1024;
+    std::array<std::atomic<Registration*>, MAX_PAGES> pages{}; ///< allocated on demand, freed with the reactor
+    std::atomic_uint32_t slotCount{0}; ///< slots ever handed out, the poll thread looks at no more than this
+    std::vector<uint32_t> freeSlots{};
+    uint32_t nextGeneration{0};
+    /// odd while the poll thread is looking at raw socket pointers. a socket leaving from another thread waits for it
+    /// to become even or change, after that the poll thread can't see it anymore
+    std::atomic_uint64_t epoch{0};
+    std::vector<std::shared_ptr<sosimple::SocketBase>> pending{}; ///< sockets to visit after leaving the epoch, reused
+
+    /// watchdog deadlines of this shard. a socket is only looked at once its deadline comes up, and if it received
+    /// something in the meantime, it's just scheduled again. packets never touch the wheel
+    TimerWheel<sosimple::SocketBase> timers{};
+    std::mutex timer_mutex{};
+    std::vector<sosimple::SocketBase*> expired{}; ///< reused by expire()
+    /// when the poll thread looks at the wheel next, guarded by timer_mutex. earlier deadlines have to wake it up
+    std::chrono::steady_clock::time_point wakeAt{std::chrono::steady_clock::time_point::max()};
+    std::chrono::steady_clock::time_point now{std::chrono::steady_clock::now()}; ///< clock of the running poll pass
+
+    /// sockets to read at the end of the poll pass, without waiting for readiness. guarded by resume_mutex
+    std::vector<std::weak_ptr<sosimple::SocketBase>> resumed{};
+    std::vector<std::weak_ptr<sosimple::SocketBase>> resuming{}; ///< swapped with resumed by the poll thread
+    /// sockets with a send queue that wait for writability, io_uring only. guarded by resume_mutex
+    std::vector<std::weak_ptr<sosimple::SocketBase>> writers{};
+    std::vector<std::weak_ptr<sosimple::SocketBase>> writing{}; ///< swapped with writers by the poll thread
+    std::mutex resume_mutex{};
+
     std::mutex socket_mutex{};
     std::thread pollThread{};
-    bool isPolling{false};
+    std::atomic_bool isPolling{false};
+    std::atomic_size_t load{0}; ///< number of sockets in this shard, for balancing without taking the lock
+#if defined __linux__
+    /// readiness queue. sockets are registered edge triggered once in operator+= and removed in operator-=,
+    /// so a poll pass only touches sockets that actually have something to read or accept
+    int epollFD{POSIX_INVALID_DESCRIPTOR};
+    /// completion queue, replaces epollFD if the io_uring backend was requested and is available
+    std::unique_ptr<IOUring> uring{};
+    /// message header template for multishot recvmsg, the kernel lays out every provided buffer after it
+    msghdr recvTemplate{};
+    /// eventfd registered with the epoll set or polled by the ring, so other threads can kick the poll thread awake
+    int wakeFD{POSIX_INVALID_DESCRIPTOR};
+    /// how long the next wait may block, -1 for "until something happens". only touched by the poll thread
+    int waitMS{-1};
+#endif
 
-    SocketPoller()=default;
+    /// @return the slot, nullptr if it was never handed out
+    auto
+    slot(uint32_t index) const -> Registration*;
+
+    /// @return the socket in a slot if it is still the tenant of that generation. only valid inside the epoch
+    auto
+    resolve(uint32_t index, uint32_t generation) const -> sosimple::SocketBase*;
+
+    /// check the watchdogs that are due
+    /// @return when the next one is due
+    auto
+    expire() -> std::optional<std::chrono::steady_clock::time_point>;
 
     auto
     operator()() -> bool;
 
+#if defined __linux__
+    /// io_uring flavour of a poll pass
+    auto
+    complete() -> bool;
+
+    /// queue the multishot receive or accept for a socket. expects socket_mutex to be held
+    auto
+    arm(SocketBase& socket, uint32_t index) -> void;
+
+    /// queue a single poll for writability, or for the error queue while only zero copy sends are outstanding. the send
+    /// queue of the socket is flushed once it completes. expects socket_mutex to be held
+    auto
+    armWritable(SocketBase& socket, uint32_t index) -> void;
+
+    /// queue the multishot poll on wakeFD
+    auto
+    armWakeup() -> void;
+
+    /// cancel an armed request by its user_data, submitted right away
+    auto
+    cancel(uint64_t request) -> void;
+#endif
+
+    /// run io on a single socket
+    /// @return true if anything was read or accepted
+    auto static
+    dispatch(std::shared_ptr<sosimple::SocketBase> const& socket) -> bool;
+
+    /// read the sockets passed to resume(), and start waiting for the ones passed to awaitWritable()
+    /// @return true if anything was read
+    auto
+    resumeAll() -> bool;
+
+    /// send the queued data of a single socket
+    /// @return true if it has nothing left to send
+    auto static
+    flush(std::shared_ptr<sosimple::SocketBase> const& socket) -> bool;
+
+    /// check the watchdog on a single socket
+    auto static
+    watch(std::shared_ptr<sosimple::SocketBase> const& socket) -> void;
+
 public:
+    explicit SocketReactor(IOBackend backend);
+    ~SocketReactor();
+
     void
-    operator+=(std::shared_ptr<sosimple::Socket> const& socket);
+    operator+=(std::shared_ptr<sosimple::SocketBase> const& socket);
 
+    /// once this returns, the poll thread is done with the socket
     void
-    operator-=(socket_t descriptor);
+    operator-=(sosimple::SocketBase& socket);
+
+    /// the socket is about to close its descriptor on its own, e.g. after an error. has to be called before closing,
+    /// the io_uring backend would otherwise keep the socket open with requests in flight
+    auto
+    release(sosimple::SocketBase const& socket) -> void;
+
+    /// interrupt the poll thread, e.g. because a watchdog needs an earlier look than planned
+    auto
+    wakeup() -> void;
+
+    /// read and flush the socket again with the next poll pass, e.g. because it stopped reading while its stream buffer
+    /// was full. readiness doesn't tell about data that is already waiting
+    auto
+    resume(sosimple::SocketBase& socket) -> void;
+
+    /// the send queue of the socket just filled up or a zero copy send went out, flush it whenever it becomes writable
+    /// until it's empty again. epoll reports writability and errors all along, the io_uring backend has to poll for it
+    auto
+    awaitWritable(sosimple::SocketBase const& socket) -> void;
+
+    /// put the socket's watchdog deadline into the timer wheel, or take it out if it has none
+    auto
+    schedule(sosimple::SocketBase& socket) -> void;
+
+    /// clock reading of the running poll pass, good enough for watchdog resets on the poll thread
+    auto
+    getTime() const -> std::chrono::steady_clock::time_point
+    { return now; }
+
+    auto
+    getLoad() const -> size_t
+    { return load; }
+};
+
+/// distributes sockets over a pool of reactors
+class SocketPoller {
+    std::vector<std::unique_ptr<SocketReactor>> reactors{};
+    std::mutex reactor_mutex{};
+    size_t reactorCount{1}; ///< how many reactors new sockets are distributed over
+    IOBackend backend{IOBackend::Epoll}; ///< what reactors created from now on use
+
+    SocketPoller()=default;
+
+public:
+    /// assign the socket to the least loaded reactor
+    void
+    operator+=(std::shared_ptr<sosimple::SocketBase> const& socket);
+
+    /// remove the socket from the reactor it was assigned to
+    void
+    operator-=(sosimple::SocketBase& socket);
+
+    /// only affects sockets started afterwards. reactors are not torn down when shrinking, existing sockets stay put
+    auto
+    setThreadCount(size_t count) -> void;
+
+    /// only affects reactors that are not running yet
+    auto
+    setBackend(IOBackend backend) -> void;
 
     auto static
     get() -> SocketPoller&;
 
 };
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,93 @@
+#if !defined SOSIMPLE_STRAND_HPP
+#define SOSIMPLE_STRAND_HPP
+
+#include "worker_impl.hpp"
+#include "mpsc_queue.hpp"
+#include <atomic>
+#include <memory>
+#include <thread>
+
+/// how many tasks a strand runs before it lets other tasks on the worker thread
+#define SC_STRAND_BATCH 64
+
+namespace sosimple {
+
+/**
+ * Serial executor on top of the Worker. Tasks posted to a strand run one at a time and in order, but not on a fixed
+ * thread, so different strands run in parallel on a worker with multiple threads.
+ */
+class Strand : public std::enable_shared_from_this<Strand> {
+    using Task = Worker::Task;
+    MPSCQueue<Task> mTasks{};
+    std::atomic_size_t mPending{0}; ///< posted and not yet run. whoever raises this from 0 queues the strand
+
+    /// queued on the worker while the strand has tasks. if the worker drops it unrun, the strand is emptied instead of stuck
+    struct Runner {
+        std::shared_ptr<Strand> strand;
+
+        explicit Runner(std::shared_ptr<Strand> owner) : strand(std::move(owner)) {}
+        Runner(Runner&&) = default;
+        ~Runner()
+        { if (strand) strand->run(false); }
+
+        auto
+        operator()() -> bool
+        {
+            auto owner = std::move(strand);
+            owner->run(true);
+            return false;
+        }
+    };
+
+    /// @return the oldest task. it was counted in mPending, but its producer might still be linking it in
+    auto
+    next() -> Task
+    {
+        while (true) {
+            auto task = mTasks.pop();
+            if (task) return std::move(*task);
+            std::this_thread::yield();
+        }
+    }
+
+    auto
+    run(bool execute) -> void
+    {
+        for (size_t done{1}; ; done++) {
+            auto task = next();
+            if (execute) {
+                try { task(); }
+                catch (...) {
+                    if (mPending.fetch_sub(1) > 1) schedule();
+                    throw;
+                }
+            }
+            if (mPending.fetch_sub(1) == 1) return;
+            if (execute && done == SC_STRAND_BATCH) {
+                schedule();
+                return;
+            }
+        }
+    }
+
+    auto
+    schedule() -> void
+    { WorkerImpl::get().queue_impl(Runner{shared_from_this()}); }
+
+public:
+    Strand() = default;
+    Strand(const Strand&) = delete;
+    Strand& operator=(const Strand&) = delete;
+
+    /// can be called from any thread. the return value of the task is ignored
+    auto
+    post(Task task) -> void
+    {
+        mTasks.push(std::move(task));
+        if (mPending.fetch_add(1) == 0) schedule();
+    }
+};
+
+}
+
+#endif
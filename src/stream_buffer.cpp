@@ -0,0 +1,113 @@
+#include <sosimple/stream_buffer.hpp>
+#include <sosimple/platforms.hpp>
+#include <sosimple/utilities.hpp>
+#include "platforms_internal.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+#if defined __linux__
+#include <sys/mman.h>
+#include <unistd.h>
+
+static auto
+mappingError(const char* what, int error) -> sosimple::socket_error
+{
+    const char* desc = GNU_STRERRORDESC_NP(error);
+    return sosimple::socket_error(sosimple::SocketError::NoMemory,
+            std::string("Unable to set up stream buffer, ") + what + ": " + (desc ? desc : "<NULLPTR>"));
+}
+#endif
+
+sosimple::StreamBuffer::StreamBuffer(size_t capacity)
+{
+#if defined __linux__
+    size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    mCapacity = std::max<size_t>((capacity + page - 1) / page * page, page);
+    // the same memory twice in a row: whatever wraps around the end continues right behind it
+    int fd = ::memfd_create("sosimple-stream", MFD_CLOEXEC);
+    int error = POSIX_ERRNO;
+    if (fd == -1 || ::ftruncate(fd, static_cast<off_t>(mCapacity)) == -1) {
+        if (fd != -1) { error = POSIX_ERRNO; ::close(fd); }
+        throw mappingError("memfd", error);
+    }
+    void* area = ::mmap(nullptr, 2 * mCapacity, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    bool mapped = area != MAP_FAILED
+        && ::mmap(area, mCapacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED
+        && ::mmap(static_cast<uint8_t*>(area) + mCapacity, mCapacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED;
+    error = POSIX_ERRNO;
+    ::close(fd);
+    if (!mapped) {
+        if (area != MAP_FAILED) ::munmap(area, 2 * mCapacity);
+        throw mappingError("mapping", error);
+    }
+    mData = static_cast<uint8_t*>(area);
+#else
+    // no double mapping, the second half is a copy that commit() keeps up to date
+    mCapacity = std::max<size_t>(capacity, 1);
+    mData = new uint8_t[2 * mCapacity];
+#endif
+}
+
+sosimple::StreamBuffer::~StreamBuffer()
+{
+#if defined __linux__
+    ::munmap(mData, 2 * mCapacity);
+#else
+    delete[] mData;
+#endif
+}
+
+auto
+sosimple::StreamBuffer::writable() -> std::span<uint8_t>
+{
+    uint64_t tail = mTail.load(std::memory_order_relaxed);
+    size_t free = mCapacity - static_cast<size_t>(tail - mHead.load(std::memory_order_acquire));
+    size_t offset = static_cast<size_t>(tail % mCapacity);
+#if !defined __linux__
+    free = std::min(free, mCapacity - offset);
+#endif
+    return {mData + offset, free};
+}
+
+auto
+sosimple::StreamBuffer::commit(size_t count) -> void
+{
+    uint64_t tail = mTail.load(std::memory_order_relaxed);
+#if !defined __linux__
+    size_t offset = static_cast<size_t>(tail % mCapacity);
+    std::memcpy(mData + mCapacity + offset, mData + offset, count);
+#endif
+    mTail.store(tail + count, std::memory_order_release);
+}
+
+auto
+sosimple::StreamBuffer::stall() -> bool
+{
+    mStalled = true;
+    // consume() might have made room before it could see the flag
+    if (!writable().empty() && mStalled.exchange(false)) return false;
+    return true;
+}
+
+auto
+sosimple::StreamBuffer::available() const -> size_t
+{
+    return static_cast<size_t>(mTail.load(std::memory_order_acquire) - mHead.load(std::memory_order_relaxed));
+}
+
+auto
+sosimple::StreamBuffer::peek() const -> std::span<const uint8_t>
+{
+    uint64_t head = mHead.load(std::memory_order_relaxed);
+    size_t size = static_cast<size_t>(mTail.load(std::memory_order_acquire) - head);
+    return {mData + head % mCapacity, size};
+}
+
+auto
+sosimple::StreamBuffer::consume(size_t count) -> void
+{
+    mHead.fetch_add(std::min(count, available()), std::memory_order_release);
+    if (mStalled.exchange(false) && mOnSpace) mOnSpace();
+}
@@ -0,0 +1,190 @@
+#if !defined SOSIMPLE_TIMER_WHEEL_HPP
+#define SOSIMPLE_TIMER_WHEEL_HPP
+
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace sosimple {
+
+/**
+ * Hierarchical timing wheel with millisecond ticks: 4 levels of 256 slots, covering about 49 days.
+ * Scheduling, rescheduling and cancelling are O(1), timers only cost something when their slot comes up or is
+ * cascaded into a lower level. Not thread safe, the owner is expected to lock around it.
+ */
+template<typename Owner>
+class TimerWheel {
+public:
+    using clock = std::chrono::steady_clock;
+
+    /// intrusive hook, embedded in whatever is being timed
+    struct Timer {
+        Timer* prev{nullptr};
+        Timer* next{nullptr}; ///< nullptr while not scheduled
+        uint64_t tick{0};
+        Owner* owner{nullptr}; ///< handed back by advance() once expired
+    };
+
+private:
+    static constexpr unsigned LEVELS = 4;
+    static constexpr unsigned SLOT_BITS = 8;
+    static constexpr unsigned SLOTS = 1u << SLOT_BITS;
+    static constexpr uint64_t SLOT_MASK = SLOTS - 1;
+    static constexpr uint64_t MAX_DELTA = (uint64_t{1} << (SLOT_BITS * LEVELS)) - 1;
+
+    clock::time_point origin;
+    uint64_t current{0}; ///< last tick that was processed
+    size_t count{0};
+    std::array<std::array<Timer, SLOTS>, LEVELS> heads{}; ///< circular list heads
+    /// which slots might hold timers. bits are set when linking and cleared lazily when a scan finds the slot empty
+    std::array<std::array<uint64_t, SLOTS / 64>, LEVELS> occupied{};
+
+    auto
+    link(Timer& timer) -> void
+    {
+        uint64_t delta = timer.tick - current;
+        unsigned level{0};
+        while (level + 1 < LEVELS && delta >= (uint64_t{1} << (SLOT_BITS * (level + 1)))) level++;
+        unsigned index = (timer.tick >> (SLOT_BITS * level)) & SLOT_MASK;
+        Timer& head = heads[level][index];
+        timer.prev = head.prev;
+        timer.next = &head;
+        head.prev->next = &timer;
+        head.prev = &timer;
+        occupied[level][index / 64] |= uint64_t{1} << (index % 64);
+    }
+
+    auto
+    unlink(Timer& timer) -> void
+    {
+        timer.prev->next = timer.next;
+        timer.next->prev = timer.prev;
+        timer.prev = timer.next = nullptr;
+    }
+
+    /// @return distance from index to the next slot with timers in (1..SLOTS, SLOTS being index itself), 0 if none
+    auto
+    scan(unsigned level, unsigned index) -> unsigned
+    {
+        for (unsigned distance{1}; distance <= SLOTS;) {
+            unsigned at = (index + distance) & SLOT_MASK;
+            uint64_t word = occupied[level][at / 64] >> (at % 64);
+            if (word == 0) {
+                distance += 64 - (at % 64); // rest of this word is empty
+                continue;
+            }
+            distance += std::countr_zero(word);
+            if (distance > SLOTS) break;
+            at = (index + distance) & SLOT_MASK;
+            Timer& head = heads[level][at];
+            if (head.next != &head) return distance;
+            occupied[level][at / 64] &= ~(uint64_t{1} << (at % 64));
+            distance++;
+        }
+        return 0;
+    }
+
+    /// move the timers of the current slot on a level down, they are due within one slot of that level
+    auto
+    cascade(unsigned level) -> void
+    {
+        unsigned index = (current >> (SLOT_BITS * level)) & SLOT_MASK;
+        // the level above feeds this one, so it goes first
+        if (index == 0 && level + 1 < LEVELS) cascade(level + 1);
+        Timer& head = heads[level][index];
+        Timer* timer = head.next;
+        head.prev = head.next = &head;
+        while (timer != &head) {
+            Timer* next = timer->next;
+            link(*timer);
+            timer = next;
+        }
+    }
+
+public:
+    explicit TimerWheel(clock::time_point start = clock::now())
+    : origin(start)
+    {
+        for (auto& level : heads) for (auto& head : level) head.prev = head.next = &head;
+    }
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    /// (re-)schedule a timer. points in the past fire with the next advance()
+    auto
+    schedule(Timer& timer, clock::time_point when) -> void
+    {
+        if (timer.next) unlink(timer);
+        else count++;
+        auto ms = std::chrono::ceil<std::chrono::milliseconds>(when - origin).count();
+        uint64_t tick = ms > 0 ? static_cast<uint64_t>(ms) : 0;
+        // beyond the last level it fires early, whoever handles it can just schedule it again
+        timer.tick = std::min(std::max(tick, current + 1), current + MAX_DELTA);
+        link(timer);
+    }
+
+    auto
+    cancel(Timer& timer) -> void
+    {
+        if (!timer.next) return;
+        unlink(timer);
+        count--;
+    }
+
+    /// collect the owners of all timers due at now. expired timers are unscheduled
+    auto
+    advance(clock::time_point now, std::vector<Owner*>& expired) -> void
+    {
+        auto ms = std::chrono::floor<std::chrono::milliseconds>(now - origin).count();
+        uint64_t target = ms > 0 ? static_cast<uint64_t>(ms) : 0;
+        while (current < target) {
+            // next tick with timers on level 0, or the next wrap, where higher levels cascade down
+            uint64_t next = target;
+            if (count > 0) {
+                unsigned index = current & SLOT_MASK;
+                unsigned distance = scan(0, index);
+                next = (distance == 0 || index + distance > SLOTS) ? current - index + SLOTS : current + distance;
+            }
+            if (next > target) {
+                current = target;
+                break;
+            }
+            current = next;
+            if ((current & SLOT_MASK) == 0) cascade(1);
+            Timer& head = heads[0][current & SLOT_MASK];
+            while (head.next != &head) {
+                Timer* timer = head.next;
+                unlink(*timer);
+                count--;
+                expired.push_back(timer->owner);
+            }
+        }
+    }
+
+    /// @return when advance() has work to do next, nothing if no timer is scheduled
+    auto
+    next() -> std::optional<clock::time_point>
+    {
+        if (count == 0) return {};
+        uint64_t earliest{UINT64_MAX};
+        for (unsigned level{0}; level < LEVELS; level++) {
+            unsigned shift = SLOT_BITS * level;
+            unsigned distance = scan(level, (current >> shift) & SLOT_MASK);
+            // timers on higher levels are not due at the start of their slot, but that's when they cascade down
+            if (distance) earliest = std::min(earliest, ((current >> shift) + distance) << shift);
+        }
+        if (earliest == UINT64_MAX) return {};
+        return origin + std::chrono::milliseconds(earliest);
+    }
+
+    auto
+    size() const -> size_t
+    { return count; }
+};
+
+}
+
+#endif
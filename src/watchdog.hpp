@@ -4,6 +4,7 @@
 #include <chrono>
 #include <functional>
 #include <iostream>
+#include <optional>
 
 namespace sosimple {
 
@@ -42,10 +43,24 @@ public:
         return fine;
     }
 
+    /// @return the point in time this watchdog trips, nothing if it is disabled
+    inline auto
+    deadline() const -> std::optional<clock::time_point>
+    {
+        if (timeout == interval::zero())
+            return {};
+        return last_reset + timeout;
+    }
+
     inline auto
     reset() -> void
     { last_reset = clock::now(); }
 
+    /// reset with a clock reading the caller already has
+    inline auto
+    reset(clock::time_point now) -> void
+    { last_reset = now; }
+
     inline auto
     check_and_reset() -> bool
     { auto tripped = check(); reset(); return tripped; }
@@ -3,39 +3,147 @@
 
 #include <set>
 #include <iostream>
+#include <algorithm>
+#include <climits>
+#include <exception>
+#include <mutex>
+
+/// how many immediate tasks are run per think, so tasks that keep queueing more can't starve timers
+#define SC_WORKER_BATCH 1024
+
+/// lane of the worker thread we're on, none for other threads
+static thread_local unsigned thisLane{UINT_MAX};
 
 auto
-sosimple::WorkerImpl::think_impl() -> std::optional<std::chrono::time_point<std::chrono::steady_clock>>
+sosimple::WorkerImpl::take(unsigned lane) -> std::optional<Task>
+{
+    if (mShareable == 0) return {};
+    unsigned lanes = mActive;
+    for (unsigned i{0}; i < lanes; i++) {
+        Lane& from = mLanes[(lane + i) % lanes];
+        std::unique_lock lock{from.mMutex};
+        if (from.mShared.empty()) continue;
+        std::optional<Task> task{};
+        if (i == 0) {
+            task = std::move(from.mShared.front());
+            from.mShared.pop_front();
+        } else {
+            task = std::move(from.mShared.back());
+            from.mShared.pop_back();
+        }
+        lock.unlock();
+        // producers wake one thread per task, and keep waking the same one until it runs. pass it on
+        if (--mShareable > 0 && mSleepers > 0) notify(lane, true);
+        return task;
+    }
+    return {};
+}
+
+auto
+sosimple::WorkerImpl::run(unsigned lane) -> bool
 {
-    auto zero = std::chrono::milliseconds(0);
+    size_t done{0};
+    for (; done < SC_WORKER_BATCH; done++) {
+        auto task = mLanes[lane].mPinned.pop();
+        if (!task) break;
+        (*task)();
+    }
+    for (; done < SC_WORKER_BATCH; done++) {
+        auto task = take(lane);
+        if (!task) break;
+        (*task)();
+    }
+    return done > 0;
+}
+
+auto
+sosimple::WorkerImpl::runTimers() -> std::optional<std::chrono::time_point<std::chrono::steady_clock>>
+{
+    // due timers are taken out while running, so they can queue, cancel and add timers themselves
     auto now = std::chrono::steady_clock::now();
-    auto next = zero;
-    bool nextSet{false};
     {
-        std::unique_lock lock(mTaskMutex);
-        for (auto& desc : mTasks) {
-            if (desc.mPeriod == zero) {
-                desc.mTask();
-                desc.mStale = true;
-            } else if (desc.mNextExec <= now) {
-                if (!desc.mTask() || state != State::Running) {
-                    desc.mStale = true;
-                    continue;
-                }
-                if (desc.mPeriod > next) {
-                    next = desc.mPeriod;
-                    nextSet = true;
-                }
-            }
+        std::unique_lock lock(mTimerMutex);
+        while (!mDeadlines.empty() && mDeadlines.front().mWhen <= now) {
+            std::pop_heap(mDeadlines.begin(), mDeadlines.end(), std::greater<>{});
+            Deadline deadline = mDeadlines.back();
+            mDeadlines.pop_back();
+            auto timer = mTimers.find(deadline.mHandle);
+            if (timer == mTimers.end()) continue; // cancelled
+            mDueTimers.push_back({deadline, std::move(timer->second.mTask)});
         }
-        //remove stale tasks
-        //mTasks.erase(std::remove_if(mTasks.begin(), mTasks.end(), [](const auto& task){ return task.mStale; }), mTasks.end());
-        std::erase_if(mTasks, [](const auto& task){ return task.mStale; });
     }
-    if (nextSet) {
-        return now+next;
-    } else {
-        return {};
+    for (auto& due : mDueTimers)
+        due.mAgain = due.mTask() && state == State::Running;
+
+    std::unique_lock lock(mTimerMutex);
+    for (auto& due : mDueTimers) {
+        auto timer = mTimers.find(due.mDeadline.mHandle);
+        if (timer == mTimers.end()) continue; // cancelled while running
+        auto period = timer->second.mPeriod;
+        if (!due.mAgain || period == std::chrono::milliseconds(0)) {
+            mTimers.erase(timer);
+            continue;
+        }
+        timer->second.mTask = std::move(due.mTask);
+        // keep the rate, unless we're so late that it would fire again right away
+        auto when = due.mDeadline.mWhen + period;
+        if (when <= now) when = now + period;
+        mDeadlines.push_back({when, due.mDeadline.mHandle});
+        std::push_heap(mDeadlines.begin(), mDeadlines.end(), std::greater<>{});
+    }
+    mDueTimers.clear();
+    // might be a cancelled one, waking early for it is fine
+    if (mDeadlines.empty()) return {};
+    return mDeadlines.front().mWhen;
+}
+
+auto
+sosimple::WorkerImpl::addTimer(Task task, std::chrono::time_point<std::chrono::steady_clock> when, std::chrono::milliseconds period) -> TaskHandle
+{
+    TaskHandle handle = mNextHandle++;
+    {
+        std::unique_lock lock(mTimerMutex);
+        mTimers.emplace(handle, Timer{std::move(task), period});
+        mDeadlines.push_back({when, handle});
+        std::push_heap(mDeadlines.begin(), mDeadlines.end(), std::greater<>{});
+    }
+    // might be earlier than what the looper is waiting for
+    notify(0, false);
+    return handle;
+}
+
+auto
+sosimple::WorkerImpl::think_impl() -> std::optional<std::chrono::time_point<std::chrono::steady_clock>>
+{
+    unsigned lane = thisLane == UINT_MAX ? 0 : thisLane;
+    run(lane);
+    if (lane != 0) return {};
+    return runTimers();
+}
+
+auto
+sosimple::WorkerImpl::loop_lane(unsigned index) -> void
+{
+    Lane& lane = mLanes[index];
+    auto idle = [&](){
+        return lane.mPinned.empty() && mShareable == 0;
+    };
+    while (state == State::Running || !idle()) {
+        bool worked = run(index);
+        std::optional<std::chrono::time_point<std::chrono::steady_clock>> next{};
+        if (index == 0) next = runTimers();
+        if (worked) continue;
+
+        std::unique_lock lock{lane.mMutex};
+        lane.mSleeping = true;
+        mSleepers++;
+        // checked after announcing that we sleep: a producer either sees us sleeping, or we see its task
+        if (lane.mPinned.empty() && mShareable == 0) {
+            if (next) lane.mNotifier.wait_until(lock, *next);
+            else if (state == State::Running) lane.mNotifier.wait(lock);
+        }
+        mSleepers--;
+        lane.mSleeping = false;
     }
 }
 
@@ -44,23 +152,54 @@ sosimple::WorkerImpl::loop_impl() -> void
 {
     if (state != State::Ready)
         throw std::runtime_error("Worker is not ready to be restarted");
+    unsigned threads = mThreads;
+    mActive = threads;
     state = State::Running;
 
-    // in case of exception, properly clean up
-    on_exit finally([&](){
-        mTasks.clear();
-        state = State::Ready;
-    });
-
-    std::unique_lock lock{mNotifyMutex};
-    while (state == State::Running || !mTasks.empty()) {
-        auto next = think_impl();
-        if (next) {
-            mNotifier.wait_until(lock, *next);
-        } else {
-            std::this_thread::yield(); //always at least yield, even if we run empty
-        }
+    std::exception_ptr failure{};
+    std::mutex failureMutex{};
+    {
+        std::vector<std::thread> helpers{};
+        // in case of exception, properly clean up
+        on_exit finally([&](){
+            state = State::Stopping;
+            for (unsigned i{1}; i < threads; i++) notify(i, false);
+            for (auto& helper : helpers) helper.join();
+            thisLane = UINT_MAX;
+            mActive = 1;
+            // we're the only thread left, so it's safe to drain the other lanes
+            for (auto& lane : mLanes) {
+                while (lane.mPinned.pop()) {}
+                std::unique_lock lock{lane.mMutex};
+                lane.mShared.clear();
+            }
+            mShareable = 0;
+            std::unique_lock lock(mTimerMutex);
+            mDeadlines.clear();
+            mTimers.clear();
+            mDueTimers.clear();
+            state = State::Ready;
+        });
+
+        thisLane = 0;
+        for (unsigned i{1}; i < threads; i++)
+            helpers.emplace_back([this, i, threads, &failure, &failureMutex](){
+                thisLane = i;
+                // an exception leaving a thread terminates the process, hand it to the looping thread instead
+                try { loop_lane(i); }
+                catch (...) {
+                    {
+                        std::unique_lock lock{failureMutex};
+                        if (!failure) failure = std::current_exception();
+                    }
+                    state = State::Stopping;
+                    for (unsigned lane{0}; lane < threads; lane++) notify(lane, false);
+                }
+            });
+        loop_lane(0);
     }
+    // the first exception of a helper, rethrown once all of them are joined
+    if (failure) std::rethrow_exception(failure);
 }
 
 auto
@@ -75,6 +214,8 @@ sosimple::WorkerImpl::stop_impl() -> void
 {
     if (state == State::Running)
     { state = State::Stopping; }
+    unsigned lanes = mActive;
+    for (unsigned i{0}; i < lanes; i++) notify(i, false);
 }
 
 auto
@@ -86,15 +227,76 @@ sosimple::WorkerImpl::started_impl() -> bool
 auto
 sosimple::WorkerImpl::queue_impl(Task task) -> void
 {
-    queue_impl(std::move(task), std::chrono::milliseconds(0));
+    unsigned lanes = mActive;
+    if (lanes == 1) {
+        mLanes[0].mPinned.push(std::move(task));
+        notify(0, false);
+        return;
+    }
+    // tasks queued by tasks stay on their thread, until some other thread runs out of work and steals them
+    unsigned lane = thisLane < lanes ? thisLane : mRoundRobin.fetch_add(1, std::memory_order_relaxed) % lanes;
+    {
+        std::unique_lock lock{mLanes[lane].mMutex};
+        mLanes[lane].mShared.push_back(std::move(task));
+    }
+    mShareable++;
+    notify(lane, true);
 }
 
 auto
-sosimple::WorkerImpl::queue_impl(Task task, std::chrono::milliseconds interval) -> void
+sosimple::WorkerImpl::queue_impl(Task task, std::chrono::milliseconds interval) -> TaskHandle
 {
-    std::unique_lock lock(mTaskMutex);
-    mTasks.push_back({std::move(task), interval});
-    mNotifier.notify_all();
+    if (interval == std::chrono::milliseconds(0)) {
+        queue_impl(std::move(task));
+        return 0;
+    }
+    return addTimer(std::move(task), std::chrono::steady_clock::now(), interval);
+}
+
+auto
+sosimple::WorkerImpl::queueDelayed_impl(Task task, std::chrono::milliseconds delay) -> TaskHandle
+{
+    return addTimer(std::move(task), std::chrono::steady_clock::now() + delay, std::chrono::milliseconds(0));
+}
+
+auto
+sosimple::WorkerImpl::cancel_impl(TaskHandle handle) -> bool
+{
+    std::unique_lock lock(mTimerMutex);
+    if (mTimers.erase(handle) == 0) return false;
+    // cancelled deadlines are skipped when they come up, but don't let them pile up
+    if (mDeadlines.size() > 2 * mTimers.size() + 1024) {
+        std::erase_if(mDeadlines, [&](const Deadline& deadline){ return !mTimers.contains(deadline.mHandle); });
+        std::make_heap(mDeadlines.begin(), mDeadlines.end(), std::greater<>{});
+    }
+    return true;
+}
+
+auto
+sosimple::WorkerImpl::setThreads_impl(unsigned count) -> void
+{
+    mThreads = std::clamp(count, 1u, static_cast<unsigned>(SC_WORKER_MAX_THREADS));
+}
+
+auto
+sosimple::WorkerImpl::notify(unsigned index, bool shareable) -> void
+{
+    // the common case, a busy worker, costs nothing here
+    Lane& lane = mLanes[index];
+    if (lane.mSleeping) {
+        std::unique_lock lock{lane.mMutex};
+        lane.mNotifier.notify_one();
+        return;
+    }
+    if (!shareable || mSleepers == 0) return;
+    unsigned lanes = mActive;
+    for (unsigned i{1}; i < lanes; i++) {
+        Lane& other = mLanes[(index + i) % lanes];
+        if (!other.mSleeping) continue;
+        std::unique_lock lock{other.mMutex};
+        other.mNotifier.notify_one();
+        return;
+    }
 }
 
 // static <-> instance glue
@@ -123,8 +325,20 @@ sosimple::Worker::isStarted() -> bool
 
 auto
 sosimple::Worker::queue(Task task) -> void
-{ WorkerImpl::get().queue_impl(task); }
+{ WorkerImpl::get().queue_impl(std::move(task)); }
+
+auto
+sosimple::Worker::queue(Task task, std::chrono::milliseconds interval) -> TaskHandle
+{ return WorkerImpl::get().queue_impl(std::move(task), interval); }
+
+auto
+sosimple::Worker::queueDelayed(Task task, std::chrono::milliseconds delay) -> TaskHandle
+{ return WorkerImpl::get().queueDelayed_impl(std::move(task), delay); }
+
+auto
+sosimple::Worker::cancel(TaskHandle handle) -> bool
+{ return WorkerImpl::get().cancel_impl(handle); }
 
 auto
-sosimple::Worker::queue(Task task, std::chrono::milliseconds interval) -> void
-{ WorkerImpl::get().queue_impl(task, interval); }
\ No newline at end of file
+sosimple::Worker::setThreads(unsigned count) -> void
+{ WorkerImpl::get().setThreads_impl(count); }
\ No newline at end of file
@@ -2,20 +2,26 @@
 #define SOSIMPLE_WORKER_IMPL_HPP
 
 #include <sosimple.hpp>
+#include "mpsc_queue.hpp"
+#include <array>
+#include <deque>
 #include <thread>
 #include <atomic>
 #include <vector>
+#include <unordered_map>
 #include <functional>
 #include <chrono>
 #include <mutex>
 #include <condition_variable>
 
+/// the most threads a worker can run
+#define SC_WORKER_MAX_THREADS 64
+
 namespace sosimple {
 
 class WorkerImpl : public Worker {
 public:
-    /** tasks can return false to stop re-scheduling. returning true on a task that is not periodic does nothing. */
-    using Task = std::function<bool()>;
+    using Task = Worker::Task;
 private:
     enum class State {
         Ready, //can be started
@@ -23,32 +29,72 @@ private:
         Stopping, //does not allow new tasks
     };
     std::atomic<State> state{State::Ready};
-    struct TaskDescriptor {
+    /// a delayed or periodic task
+    struct Timer {
         Task mTask;
-        std::chrono::milliseconds mPeriod;
-        std::chrono::time_point<std::chrono::steady_clock> mNextExec;
-        bool mStale{false};
-
-        /** There are some oddities with lazy loading library symbols. Make sure your task function is resolved by the loader before passing it in! */
-        inline
-        TaskDescriptor(Task task, std::chrono::milliseconds interval)
-        : mTask{task}, mPeriod{interval}, mNextExec{std::chrono::steady_clock::now()} {}
+        std::chrono::milliseconds mPeriod; //zero for tasks that run once
+    };
+    /// entry in the timer heap
+    struct Deadline {
+        std::chrono::time_point<std::chrono::steady_clock> mWhen;
+        TaskHandle mHandle;
 
-        //make sortable
         inline auto
-        operator<(const TaskDescriptor& other) -> bool
-        {
-            if (this->mPeriod == std::chrono::milliseconds(0) || other.mPeriod == std::chrono::milliseconds(0))
-                return this->mPeriod < other.mPeriod; //whatever has no period goes first
-            return this->mNextExec < other.mNextExec;
-        }
-
-        friend class WorkerImpl;
+        operator>(const Deadline& other) const -> bool
+        { return mWhen > other.mWhen; }
+    };
+    /// a timer taken out for running
+    struct DueTimer {
+        Deadline mDeadline;
+        Task mTask;
+        bool mAgain{false};
+    };
+
+    /// one per worker thread
+    struct Lane {
+        MPSCQueue<Task> mPinned; //tasks only this thread runs, pushed without locking. used while the worker runs on one thread
+        std::mutex mMutex; //guards mShared, also used to wait for tasks
+        std::deque<Task> mShared; //tasks any thread can steal, the owner takes from the front, thieves from the back
+        std::condition_variable mNotifier; //notify about new tasks
+        std::atomic_bool mSleeping{false}; //producers only need to notify if the thread is about to wait
     };
-    std::mutex mTaskMutex;
-    std::vector<TaskDescriptor> mTasks;
-    std::mutex mNotifyMutex;
-    std::condition_variable mNotifier; //notify about new tasks
+    std::array<Lane, SC_WORKER_MAX_THREADS> mLanes{};
+    std::atomic_uint mThreads{1}; //threads to start with the next loop
+    std::atomic_uint mActive{1}; //lanes in use. only changes while no worker thread runs
+    std::atomic_uint mRoundRobin{0}; //lane for the next task queued from outside the worker
+    std::atomic_size_t mShareable{0}; //tasks in all mShared deques
+    std::atomic_uint mSleepers{0}; //threads that are waiting or about to
+    std::mutex mTimerMutex; //guards mDeadlines and mTimers, timers run without it
+    std::vector<Deadline> mDeadlines; //min-heap. cancelled timers stay in here until they come up or get compacted away
+    std::unordered_map<TaskHandle, Timer> mTimers; //run on the thread that called looper(). the task is empty while it runs
+    std::vector<DueTimer> mDueTimers; //reused
+    std::atomic<TaskHandle> mNextHandle{1};
+
+    /// take a task from the lanes mShared, or steal one from another lane
+    auto
+    take(unsigned lane) -> std::optional<Task>;
+
+    /// run a batch of the immediate tasks for a lane
+    /// @return true if any task was run
+    auto
+    run(unsigned lane) -> bool;
+
+    /// run timers that are due
+    /// @return when the next timer is due
+    auto
+    runTimers() -> std::optional<std::chrono::time_point<std::chrono::steady_clock>>;
+
+    auto
+    addTimer(Task task, std::chrono::time_point<std::chrono::steady_clock> when, std::chrono::milliseconds period) -> TaskHandle;
+
+    /// main loop of a single worker thread
+    auto
+    loop_lane(unsigned lane) -> void;
+
+    /// wake the thread for a lane if it is waiting for tasks
+    /// @param shareable wake any other waiting thread instead, it can steal the task
+    auto
+    notify(unsigned lane, bool shareable) -> void;
 
 public:
     /// hide constructor for singleton
@@ -57,7 +103,7 @@ public:
     ~WorkerImpl()
     override = default;
 
-    /// process tasks once and return next process timepoint
+    /// process tasks once and return next process timepoint. on a worker thread this processes the tasks of its lane
     auto
     think_impl() -> std::optional<std::chrono::time_point<std::chrono::steady_clock>>;
 
@@ -67,7 +113,7 @@ public:
     auto
     loop_impl() -> void;
 
-    /// stop the worker, will finish pending tasks. main purpose is to signal
+    /// stop the worker, will finish queued tasks and drop timers. main purpose is to signal
     /// the working thread to stop. after being stopped, you can restart the
     /// worker by re-entering looper()
     auto
@@ -80,7 +126,16 @@ public:
     queue_impl(Task task) -> void;
 
     auto
-    queue_impl(Task task, std::chrono::milliseconds interval) -> void;
+    queue_impl(Task task, std::chrono::milliseconds interval) -> TaskHandle;
+
+    auto
+    queueDelayed_impl(Task task, std::chrono::milliseconds delay) -> TaskHandle;
+
+    auto
+    cancel_impl(TaskHandle handle) -> bool;
+
+    auto
+    setThreads_impl(unsigned count) -> void;
 
     /** get the worker singleton. it's a singleton so other components can cueue more easily */
     static auto